@@ -0,0 +1,108 @@
+#include "bench/corpus.h"
+
+using namespace llox;
+
+std::string bench::identifierDense(std::size_t size) {
+  std::string source;
+  for (std::size_t index = 0; source.size() < size; ++index) {
+    std::string name = "some_rather_long_identifier_" + std::to_string(index);
+    source += "var " + name + " = another_identifier_" +
+              std::to_string(index % 97) + ";\n";
+    source += name + " = " + name + " + yet_another_identifier;\n";
+  }
+  return source;
+}
+
+std::string bench::numberDense(std::size_t size) {
+  std::string source;
+  for (std::size_t index = 0; source.size() < size; ++index) {
+    source += "print " + std::to_string(index) + " + " +
+              std::to_string(index * 7919 % 100000) + ".25 * 3.14159 - " +
+              std::to_string(index % 1000) + " / 17.5;\n";
+  }
+  return source;
+}
+
+std::string bench::commentHeavy(std::size_t size) {
+  std::string source;
+  for (std::size_t index = 0; source.size() < size; ++index) {
+    source += "// This line explains at some length what the statement below "
+              "does, and why.\n";
+    source += "// It goes on for a second line, as comments often do.\n";
+    source += "var c" + std::to_string(index) + " = nil;\n";
+  }
+  return source;
+}
+
+std::string bench::deepNesting(std::size_t depth) {
+  std::string source;
+  for (std::size_t index = 0; index < depth; ++index) source += "{\n";
+  source += "print ";
+  for (std::size_t index = 0; index < depth; ++index) source += "(1 + ";
+  source += "1";
+  for (std::size_t index = 0; index < depth; ++index) source += ")";
+  source += ";\n";
+  for (std::size_t index = 0; index < depth; ++index) source += "}\n";
+  return source;
+}
+
+std::string bench::wideStatements(std::size_t count) {
+  std::string source;
+  for (std::size_t index = 0; index < count; ++index) {
+    std::string name = "v" + std::to_string(index);
+    switch (index % 4) {
+      case 0:
+        source += "var " + name + " = " + std::to_string(index) + ";\n";
+        break;
+      case 1:
+        source += "if (" + name + " < 10 and true) print \"small\"; " +
+                  "else print \"large\";\n";
+        break;
+      case 2:
+        source += "while (false) { " + name + " = " + name + " - 1; }\n";
+        break;
+      case 3:
+        source += "print -" + name + " * (2 + 3) == !false;\n";
+        break;
+    }
+  }
+  return source;
+}
+
+std::string bench::arithmeticKernel(std::size_t iterations) {
+  return "var sum = 0;\n"
+         "var i = 0;\n"
+         "while (i < " +
+         std::to_string(iterations) +
+         ") {\n"
+         "  sum = sum + i * 2 - i / 4 + i % 7;\n"
+         "  i = i + 1;\n"
+         "}\n"
+         "print sum;\n";
+}
+
+std::string bench::stringKernel(std::size_t iterations) {
+  return "var s = \"\";\n"
+         "for (var i = 0; i < " +
+         std::to_string(iterations) +
+         "; i = i + 1) {\n"
+         "  s = s + \"ab\";\n"
+         "}\n"
+         "print s == \"\";\n";
+}
+
+std::string bench::controlFlowKernel(std::size_t iterations) {
+  return "fun fib(n) {\n"
+         "  if (n < 2) return n;\n"
+         "  return fib(n - 1) + fib(n - 2);\n"
+         "}\n"
+         "var count = 0;\n"
+         "for (var i = 0; i < " +
+         std::to_string(iterations) +
+         "; i = i + 1) {\n"
+         "  if (i % 3 == 0 or i % 5 == 0) count = count + 1;\n"
+         "  else if (!(i % 2 == 0) and i > 10) count = count - 1;\n"
+         "  else count = count + fib(5);\n"
+         "}\n"
+         "print count;\n";
+}
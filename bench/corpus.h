@@ -0,0 +1,41 @@
+#ifndef LLOX_BENCH_CORPUS_H
+#define LLOX_BENCH_CORPUS_H
+
+#include <cstddef>
+#include <string>
+
+namespace llox {
+namespace bench {
+
+/// Synthetic scripts for the benchmarks. Each generator is deterministic, so
+/// runs of different builds measure the same input. Sizes are approximate and
+/// in bytes unless noted otherwise.
+
+/// Declarations and assignments of long identifiers.
+std::string identifierDense(std::size_t size);
+
+/// Arithmetic on many integer and fractional literals.
+std::string numberDense(std::size_t size);
+
+/// Short statements between long line comments.
+std::string commentHeavy(std::size_t size);
+
+/// A single expression nested `depth` parentheses and blocks deep.
+std::string deepNesting(std::size_t depth);
+
+/// `count` independent top-level statements of mixed kinds.
+std::string wideStatements(std::size_t count);
+
+/// Loops over `iterations` of integer arithmetic.
+std::string arithmeticKernel(std::size_t iterations);
+
+/// Grows a string by concatenation `iterations` times.
+std::string stringKernel(std::size_t iterations);
+
+/// Branches, logical operators and recursive calls, `iterations` times.
+std::string controlFlowKernel(std::size_t iterations);
+
+}  // namespace bench
+}  // namespace llox
+
+#endif
@@ -0,0 +1,79 @@
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <string>
+
+#include "bench/corpus.h"
+#include "lox/interpreter.h"
+#include "lox/memory-stats.h"
+#include "lox/output.h"
+#include "lox/program.h"
+
+using namespace llox;
+
+namespace {
+
+/// Compiles `source` once and runs it in a fresh interpreter per iteration,
+/// with its output discarded.
+void run(benchmark::State& state, const std::string& source) {
+  StringOutputSink errors;
+  std::unique_ptr<const Program> program = Program::compile(source, errors);
+  if (!program) {
+    state.SkipWithError("compile failed");
+    return;
+  }
+  for (auto _ : state) {
+    StringOutputSink output;
+    InterpreterOptions options;
+    options.output = &output;
+    options.errors = &errors;
+    Interpreter interpreter(options);
+    interpreter.interpret(*program);
+    benchmark::DoNotOptimize(output.str());
+  }
+  if (!errors.str().empty()) state.SkipWithError("run failed");
+}
+
+void BM_Arithmetic(benchmark::State& state) {
+  run(state, bench::arithmeticKernel(state.range(0)));
+}
+BENCHMARK(BM_Arithmetic)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+void BM_Strings(benchmark::State& state) {
+  run(state, bench::stringKernel(state.range(0)));
+}
+BENCHMARK(BM_Strings)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+void BM_ControlFlow(benchmark::State& state) {
+  run(state, bench::controlFlowKernel(state.range(0)));
+}
+BENCHMARK(BM_ControlFlow)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+/// Comparisons of existing variables, which must not allocate once the
+/// variables are defined.
+void BM_SteadyStateLookups(benchmark::State& state) {
+  StringOutputSink output;
+  InterpreterOptions options;
+  options.output = &output;
+  options.errors = &output;
+  Interpreter interpreter(options);
+  std::unique_ptr<const Program> globals =
+      Program::compile("var a = 1; var b = 2; var c = 3;", output);
+  std::unique_ptr<const Program> lookups =
+      Program::compile("a < b and b < c and c != a;", output);
+  if (!globals || !lookups) {
+    state.SkipWithError("compile failed");
+    return;
+  }
+  interpreter.interpret(*globals);
+  const Stmt& stmt = *lookups->getStatements().front();
+
+  AllocationCheck check;
+  for (auto _ : state) interpreter.interpret(stmt);
+  check.assertNone("a steady-state lookup");
+}
+BENCHMARK(BM_SteadyStateLookups);
+
+}  // namespace
+
+BENCHMARK_MAIN();
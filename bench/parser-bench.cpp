@@ -0,0 +1,69 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "bench/corpus.h"
+#include "lox/ast-printer.h"
+#include "lox/output.h"
+#include "lox/parser.h"
+#include "lox/scanner.h"
+
+using namespace llox;
+
+namespace {
+
+/// Parsing consumes its tokens, so each iteration scans afresh with the
+/// timer paused.
+void parse(benchmark::State& state, const std::string& source) {
+  StringOutputSink errors;
+  for (auto _ : state) {
+    state.PauseTiming();
+    Scanner scanner(source, errors);
+    Parser parser(scanner.scanTokens(), errors);
+    state.ResumeTiming();
+    std::unique_ptr<StmtList> statements = parser.parse();
+    benchmark::DoNotOptimize(statements);
+    if (parser.hadError()) state.SkipWithError("parse failed");
+  }
+  state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+void print(benchmark::State& state, const std::string& source) {
+  StringOutputSink errors;
+  Scanner scanner(source, errors);
+  Parser parser(scanner.scanTokens(), errors);
+  std::unique_ptr<StmtList> statements = parser.parse();
+  if (parser.hadError()) {
+    state.SkipWithError("parse failed");
+    return;
+  }
+  for (auto _ : state) {
+    AstPrinter printer;
+    std::string representation = printer.print(*statements);
+    benchmark::DoNotOptimize(representation);
+  }
+}
+
+void BM_ParseDeep(benchmark::State& state) {
+  parse(state, bench::deepNesting(state.range(0)));
+}
+BENCHMARK(BM_ParseDeep)->Arg(16)->Arg(256);
+
+void BM_ParseWide(benchmark::State& state) {
+  parse(state, bench::wideStatements(state.range(0)));
+}
+BENCHMARK(BM_ParseWide)->Arg(1 << 10)->Arg(16 << 10);
+
+void BM_PrintDeep(benchmark::State& state) {
+  print(state, bench::deepNesting(state.range(0)));
+}
+BENCHMARK(BM_PrintDeep)->Arg(16)->Arg(256);
+
+void BM_PrintWide(benchmark::State& state) {
+  print(state, bench::wideStatements(state.range(0)));
+}
+BENCHMARK(BM_PrintWide)->Arg(1 << 10)->Arg(4 << 10);
+
+}  // namespace
+
+BENCHMARK_MAIN();
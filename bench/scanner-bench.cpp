@@ -0,0 +1,41 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "bench/corpus.h"
+#include "lox/output.h"
+#include "lox/scanner.h"
+
+using namespace llox;
+
+namespace {
+
+void scan(benchmark::State& state, const std::string& source) {
+  StringOutputSink errors;
+  for (auto _ : state) {
+    Scanner scanner(source, errors);
+    std::unique_ptr<Scanner::TokenList> tokens = scanner.scanTokens();
+    benchmark::DoNotOptimize(tokens);
+  }
+  state.SetBytesProcessed(state.iterations() * source.size());
+  if (!errors.str().empty()) state.SkipWithError("scan failed");
+}
+
+void BM_ScanIdentifiers(benchmark::State& state) {
+  scan(state, bench::identifierDense(state.range(0)));
+}
+BENCHMARK(BM_ScanIdentifiers)->Arg(64 << 10)->Arg(1 << 20);
+
+void BM_ScanNumbers(benchmark::State& state) {
+  scan(state, bench::numberDense(state.range(0)));
+}
+BENCHMARK(BM_ScanNumbers)->Arg(64 << 10)->Arg(1 << 20);
+
+void BM_ScanComments(benchmark::State& state) {
+  scan(state, bench::commentHeavy(state.range(0)));
+}
+BENCHMARK(BM_ScanComments)->Arg(64 << 10)->Arg(1 << 20);
+
+}  // namespace
+
+BENCHMARK_MAIN();
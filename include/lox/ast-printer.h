@@ -11,35 +11,35 @@ class AstPrinter : public ExprVisitor, public StmtVisitor {
  public:
   AstPrinter() {}
 
-  std::string print(StmtList& statements);
+  std::string print(const StmtList& statements);
 
   /// Expressions.
-  void visit(AssignExpr* expr) override;
-  void visit(BinaryExpr* expr) override;
-  void visit(CallExpr* expr) override;
-  void visit(GetExpr* expr) override;
-  void visit(GroupingExpr* expr) override;
-  void visit(BoolLiteralExpr* expr) override;
-  void visit(NilLiteralExpr* expr) override;
-  void visit(NumberLiteralExpr* expr) override;
-  void visit(StringLiteralExpr* expr) override;
-  void visit(LogicalExpr* expr) override;
-  void visit(SetExpr* expr) override;
-  void visit(SuperExpr* expr) override;
-  void visit(ThisExpr* expr) override;
-  void visit(UnaryExpr* expr) override;
-  void visit(VariableExpr* expr) override;
+  void visit(const AssignExpr* expr) override;
+  void visit(const BinaryExpr* expr) override;
+  void visit(const CallExpr* expr) override;
+  void visit(const GetExpr* expr) override;
+  void visit(const GroupingExpr* expr) override;
+  void visit(const BoolLiteralExpr* expr) override;
+  void visit(const NilLiteralExpr* expr) override;
+  void visit(const NumberLiteralExpr* expr) override;
+  void visit(const StringLiteralExpr* expr) override;
+  void visit(const LogicalExpr* expr) override;
+  void visit(const SetExpr* expr) override;
+  void visit(const SuperExpr* expr) override;
+  void visit(const ThisExpr* expr) override;
+  void visit(const UnaryExpr* expr) override;
+  void visit(const VariableExpr* expr) override;
 
   /// Statements.
-  void visit(BlockStmt* stmt) override;
-  void visit(ClassStmt* stmt) override;
-  void visit(ExpressionStmt* stmt) override;
-  void visit(FunctionStmt* stmt) override;
-  void visit(IfStmt* stmt) override;
-  void visit(PrintStmt* stmt) override;
-  void visit(ReturnStmt* stmt) override;
-  void visit(VarStmt* stmt) override;
-  void visit(WhileStmt* stmt) override;
+  void visit(const BlockStmt* stmt) override;
+  void visit(const ClassStmt* stmt) override;
+  void visit(const ExpressionStmt* stmt) override;
+  void visit(const FunctionStmt* stmt) override;
+  void visit(const IfStmt* stmt) override;
+  void visit(const PrintStmt* stmt) override;
+  void visit(const ReturnStmt* stmt) override;
+  void visit(const VarStmt* stmt) override;
+  void visit(const WhileStmt* stmt) override;
 
  private:
   template <typename... ExprT>
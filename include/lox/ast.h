@@ -1,9 +1,12 @@
 #ifndef LLOX_AST_H
 #define LLOX_AST_H
 
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "region.h"
 #include "token.h"
 #include "util.h"
 
@@ -29,24 +32,24 @@ class VariableExpr;
 
 class ExprVisitor {
  public:
-  virtual void visit(AssignExpr* expr) = 0;
-  virtual void visit(BinaryExpr* expr) = 0;
-  virtual void visit(CallExpr* expr) = 0;
-  virtual void visit(GetExpr* expr) = 0;
-  virtual void visit(GroupingExpr* expr) = 0;
-  virtual void visit(BoolLiteralExpr* expr) = 0;
-  virtual void visit(NilLiteralExpr* expr) = 0;
-  virtual void visit(NumberLiteralExpr* expr) = 0;
-  virtual void visit(StringLiteralExpr* expr) = 0;
-  virtual void visit(LogicalExpr* expr) = 0;
-  virtual void visit(SetExpr* expr) = 0;
-  virtual void visit(SuperExpr* expr) = 0;
-  virtual void visit(ThisExpr* expr) = 0;
-  virtual void visit(UnaryExpr* expr) = 0;
-  virtual void visit(VariableExpr* expr) = 0;
+  virtual void visit(const AssignExpr* expr) = 0;
+  virtual void visit(const BinaryExpr* expr) = 0;
+  virtual void visit(const CallExpr* expr) = 0;
+  virtual void visit(const GetExpr* expr) = 0;
+  virtual void visit(const GroupingExpr* expr) = 0;
+  virtual void visit(const BoolLiteralExpr* expr) = 0;
+  virtual void visit(const NilLiteralExpr* expr) = 0;
+  virtual void visit(const NumberLiteralExpr* expr) = 0;
+  virtual void visit(const StringLiteralExpr* expr) = 0;
+  virtual void visit(const LogicalExpr* expr) = 0;
+  virtual void visit(const SetExpr* expr) = 0;
+  virtual void visit(const SuperExpr* expr) = 0;
+  virtual void visit(const ThisExpr* expr) = 0;
+  virtual void visit(const UnaryExpr* expr) = 0;
+  virtual void visit(const VariableExpr* expr) = 0;
 };
 
-class Expr {
+class Expr : public CountedRegionAllocated<SyntaxTreeMemory> {
  public:
   enum ExprKind {
     AssignExprKind,
@@ -74,7 +77,7 @@ class Expr {
 
   virtual std::unique_ptr<Expr> clone() = 0;
 
-  virtual void accept(ExprVisitor& visitor) = 0;
+  virtual void accept(ExprVisitor& visitor) const = 0;
 };
 
 class AssignExpr : public Expr {
@@ -91,7 +94,7 @@ class AssignExpr : public Expr {
     return llox::make_unique<AssignExpr>(name->clone(), value->clone());
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class BinaryExpr : public Expr {
@@ -112,7 +115,7 @@ class BinaryExpr : public Expr {
                                          right->clone());
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class CallExpr : public Expr {
@@ -138,7 +141,7 @@ class CallExpr : public Expr {
                                        new_arguments);
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class GetExpr : public Expr {
@@ -155,7 +158,7 @@ class GetExpr : public Expr {
     return llox::make_unique<GetExpr>(object->clone(), name->clone());
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class GroupingExpr : public Expr {
@@ -169,7 +172,7 @@ class GroupingExpr : public Expr {
     return llox::make_unique<GroupingExpr>(expression->clone());
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class BoolLiteralExpr : public Expr {
@@ -182,7 +185,7 @@ class BoolLiteralExpr : public Expr {
     return llox::make_unique<BoolLiteralExpr>(value);
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class NilLiteralExpr : public Expr {
@@ -193,7 +196,7 @@ class NilLiteralExpr : public Expr {
     return llox::make_unique<NilLiteralExpr>();
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class NumberLiteralExpr : public Expr {
@@ -207,7 +210,7 @@ class NumberLiteralExpr : public Expr {
     return llox::make_unique<NumberLiteralExpr>(value);
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class StringLiteralExpr : public Expr {
@@ -221,7 +224,7 @@ class StringLiteralExpr : public Expr {
     return llox::make_unique<StringLiteralExpr>(value);
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class LogicalExpr : public Expr {
@@ -242,7 +245,7 @@ class LogicalExpr : public Expr {
                                           right->clone());
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class SetExpr : public Expr {
@@ -263,7 +266,7 @@ class SetExpr : public Expr {
                                       value->clone());
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class SuperExpr : public Expr {
@@ -280,7 +283,7 @@ class SuperExpr : public Expr {
     return llox::make_unique<SuperExpr>(keyword->clone(), method->clone());
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class ThisExpr : public Expr {
@@ -294,7 +297,7 @@ class ThisExpr : public Expr {
     return llox::make_unique<ThisExpr>(keyword->clone());
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class UnaryExpr : public Expr {
@@ -309,7 +312,7 @@ class UnaryExpr : public Expr {
     return llox::make_unique<UnaryExpr>(op->clone(), right->clone());
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class VariableExpr : public Expr {
@@ -323,7 +326,7 @@ class VariableExpr : public Expr {
     return llox::make_unique<VariableExpr>(name->clone());
   }
 
-  void accept(ExprVisitor& visitor) override { visitor.visit(this); }
+  void accept(ExprVisitor& visitor) const override { visitor.visit(this); }
 };
 
 template <typename T, typename... Args>
@@ -345,18 +348,18 @@ class WhileStmt;
 
 class StmtVisitor {
  public:
-  virtual void visit(BlockStmt* stmt) = 0;
-  virtual void visit(ClassStmt* stmt) = 0;
-  virtual void visit(ExpressionStmt* stmt) = 0;
-  virtual void visit(FunctionStmt* stmt) = 0;
-  virtual void visit(IfStmt* stmt) = 0;
-  virtual void visit(PrintStmt* stmt) = 0;
-  virtual void visit(ReturnStmt* stmt) = 0;
-  virtual void visit(VarStmt* stmt) = 0;
-  virtual void visit(WhileStmt* stmt) = 0;
+  virtual void visit(const BlockStmt* stmt) = 0;
+  virtual void visit(const ClassStmt* stmt) = 0;
+  virtual void visit(const ExpressionStmt* stmt) = 0;
+  virtual void visit(const FunctionStmt* stmt) = 0;
+  virtual void visit(const IfStmt* stmt) = 0;
+  virtual void visit(const PrintStmt* stmt) = 0;
+  virtual void visit(const ReturnStmt* stmt) = 0;
+  virtual void visit(const VarStmt* stmt) = 0;
+  virtual void visit(const WhileStmt* stmt) = 0;
 };
 
-class Stmt {
+class Stmt : public CountedRegionAllocated<SyntaxTreeMemory> {
  public:
   enum StmtKind {
     BlockStmtKind,
@@ -378,7 +381,7 @@ class Stmt {
 
   virtual std::unique_ptr<Stmt> clone() = 0;
 
-  virtual void accept(StmtVisitor& visitor) = 0;
+  virtual void accept(StmtVisitor& visitor) const = 0;
 };
 
 class BlockStmt : public Stmt {
@@ -396,7 +399,7 @@ class BlockStmt : public Stmt {
     return llox::make_unique<BlockStmt>(new_statements);
   }
 
-  void accept(StmtVisitor& visitor) override { visitor.visit(this); }
+  void accept(StmtVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class ExpressionStmt : public Stmt {
@@ -410,35 +413,66 @@ class ExpressionStmt : public Stmt {
     return llox::make_unique<ExpressionStmt>(expression->clone());
   }
 
-  void accept(StmtVisitor& visitor) override { visitor.visit(this); }
+  void accept(StmtVisitor& visitor) const override { visitor.visit(this); }
 };
 
+/// A function declaration. Its body may be kept as tokens until the function
+/// is first called; use `Parser::functionBody` to get the statements.
 class FunctionStmt : public Stmt {
  public:
   std::unique_ptr<Token> name;
   std::vector<std::unique_ptr<Token>> parameters;
-  std::vector<std::unique_ptr<Stmt>> body;
+  mutable std::vector<std::unique_ptr<Stmt>> body;
+
+  /// The tokens of a body that has not been parsed yet, packed by the
+  /// parser into a compact encoding of about the size of the source text.
+  mutable std::string bodyCode;
+
+  /// Guards the parse of `bodyTokens`, which may happen while the program is
+  /// shared between threads.
+  mutable std::once_flag bodyParsed;
+
+  /// The diagnostics of a body that failed to parse, or empty.
+  mutable std::string bodyErrors;
+
+  /// The function's `PerfMap` trampoline, once it has been called with the
+  /// map open.
+  mutable std::atomic<void*> perfTrampoline{nullptr};
 
   FunctionStmt(std::unique_ptr<Token> name,
                std::vector<std::unique_ptr<Token>>& function_parameters,
                std::vector<std::unique_ptr<Stmt>>& function_body)
-      : Stmt(FunctionStmtKind) {
+      : Stmt(FunctionStmtKind), name(std::move(name)) {
     for (auto& parameter : function_parameters)
       parameters.push_back(std::move(parameter));
     for (auto& stmt : function_body) body.push_back(std::move(stmt));
   }
 
+  FunctionStmt(std::unique_ptr<Token> name,
+               std::vector<std::unique_ptr<Token>>& function_parameters,
+               std::string& function_body_code)
+      : Stmt(FunctionStmtKind), name(std::move(name)) {
+    for (auto& parameter : function_parameters)
+      parameters.push_back(std::move(parameter));
+    bodyCode.swap(function_body_code);
+  }
+
   std::unique_ptr<Stmt> clone() override {
     std::vector<std::unique_ptr<Token>> new_parameters;
     for (auto& parameter : parameters)
       new_parameters.push_back(parameter->clone());
+    if (!bodyCode.empty()) {
+      std::string new_code = bodyCode;
+      return llox::make_unique<FunctionStmt>(name->clone(), new_parameters,
+                                             new_code);
+    }
     std::vector<std::unique_ptr<Stmt>> new_body;
     for (auto& stmt : body) new_body.push_back(stmt->clone());
     return llox::make_unique<FunctionStmt>(name->clone(), new_parameters,
                                            new_body);
   }
 
-  void accept(StmtVisitor& visitor) override { visitor.visit(this); }
+  void accept(StmtVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class ClassStmt : public Stmt {
@@ -462,7 +496,7 @@ class ClassStmt : public Stmt {
                                         new_methods);
   }
 
-  void accept(StmtVisitor& visitor) override { visitor.visit(this); }
+  void accept(StmtVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class IfStmt : public Stmt {
@@ -483,7 +517,7 @@ class IfStmt : public Stmt {
                                      elseBranch->clone());
   }
 
-  void accept(StmtVisitor& visitor) override { visitor.visit(this); }
+  void accept(StmtVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class PrintStmt : public Stmt {
@@ -497,7 +531,7 @@ class PrintStmt : public Stmt {
     return llox::make_unique<PrintStmt>(expression->clone());
   }
 
-  void accept(StmtVisitor& visitor) override { visitor.visit(this); }
+  void accept(StmtVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class ReturnStmt : public Stmt {
@@ -514,7 +548,7 @@ class ReturnStmt : public Stmt {
     return llox::make_unique<ReturnStmt>(keyword->clone(), value->clone());
   }
 
-  void accept(StmtVisitor& visitor) override { visitor.visit(this); }
+  void accept(StmtVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class VarStmt : public Stmt {
@@ -531,7 +565,7 @@ class VarStmt : public Stmt {
     return llox::make_unique<VarStmt>(name->clone(), initializer->clone());
   }
 
-  void accept(StmtVisitor& visitor) override { visitor.visit(this); }
+  void accept(StmtVisitor& visitor) const override { visitor.visit(this); }
 };
 
 class WhileStmt : public Stmt {
@@ -548,7 +582,7 @@ class WhileStmt : public Stmt {
     return llox::make_unique<WhileStmt>(condition->clone(), body->clone());
   }
 
-  void accept(StmtVisitor& visitor) override { visitor.visit(this); }
+  void accept(StmtVisitor& visitor) const override { visitor.visit(this); }
 };
 
 typedef std::vector<std::unique_ptr<Stmt>> StmtList;
@@ -0,0 +1,85 @@
+#ifndef LLOX_BINARY_FILE_H
+#define LLOX_BINARY_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace llox {
+
+/// Marks the byte order of the files written with `BinaryWriter`, whose
+/// values are in host byte order. A file written on a machine of the other
+/// order does not match it.
+constexpr std::uint32_t kByteOrderMark = 0x01020304;
+
+/// Writes `contents` to `path` through a private temporary that is renamed
+/// into place, so that readers never observe a partially written file.
+bool writeFileAtomically(const std::string& path, const std::string& contents);
+
+/// Encodes values in host byte order, with strings kept apart in a table and
+/// referred to by offset and length.
+class BinaryWriter {
+ public:
+  std::string data;
+  std::string strings;
+
+  void raw(const void* value, std::size_t size) {
+    data.append(static_cast<const char*>(value), size);
+  }
+
+  void u8(std::uint8_t value) { raw(&value, sizeof(value)); }
+
+  void u32(std::uint32_t value) { raw(&value, sizeof(value)); }
+
+  /// Identical strings share one entry in the table.
+  void string(const std::string& value);
+
+ private:
+  std::unordered_map<std::string, std::uint32_t> offsets;
+};
+
+/// Decodes what a `BinaryWriter` wrote, checking every read against the
+/// bounds of the data. Reading past them, or anything `fail`s, makes the
+/// reader invalid, and every read after that returns zero.
+class BinaryReader {
+  const char* bytes;
+  std::size_t size;
+  const char* strings;
+  std::size_t stringsSize;
+  std::size_t position = 0;
+  bool valid = true;
+
+ public:
+  BinaryReader(const char* bytes, std::size_t size, const char* strings,
+               std::size_t stringsSize)
+      : bytes(bytes), size(size), strings(strings), stringsSize(stringsSize) {}
+
+  bool isValid() const { return valid; }
+
+  /// True if everything read so far was well formed and all of the data
+  /// has been consumed.
+  bool finished() const { return valid && position == size; }
+
+  void fail() { valid = false; }
+
+  void raw(void* value, std::size_t length);
+
+  std::uint8_t u8() {
+    std::uint8_t value;
+    raw(&value, sizeof(value));
+    return value;
+  }
+
+  std::uint32_t u32() {
+    std::uint32_t value;
+    raw(&value, sizeof(value));
+    return value;
+  }
+
+  std::string string();
+};
+
+}  // namespace llox
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef LLOX_DOCUMENT_H
+#define LLOX_DOCUMENT_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "interpreter.h"
+
+namespace llox {
+
+/// A script that is edited in place and parsed incrementally.
+///
+/// The text is kept as a sequence of segments, each holding one top-level
+/// statement as found by `splitStatements` along with its parse. An edit
+/// rescans and reparses only the segments it touches, growing the region
+/// while the new text does not end at a statement boundary, and keeps the
+/// statements of all other segments as they are. Re-parsing after an edit
+/// therefore costs about as much as the statements it changed.
+///
+/// Statements in segments that were not reparsed keep the line numbers
+/// they were parsed with, so their tokens may be off after an edit that
+/// adds or removes lines above them. `interpret` hands the interpreter a
+/// share of each segment that declares functions, so those functions stay
+/// callable after an edit replaces the text they came from.
+class Document {
+  struct Segment {
+    std::size_t begin;
+    std::size_t end;
+    unsigned int line;
+    std::shared_ptr<StmtList> statements;
+    /// Whether the statements declare any functions.
+    bool functions;
+    std::string errors;
+    bool failed;
+  };
+
+  std::string text;
+  std::vector<std::unique_ptr<Segment>> segments;
+  std::size_t reparsed = 0;
+
+  /// Moving every later segment after each edit would cost time in the size
+  /// of the text, so the offsets and lines of the segments from `shiftFrom`
+  /// on are stale by `shiftBy` and `shiftLines` instead. Only the segments
+  /// between one edit and the next have to be brought up to date.
+  std::size_t shiftFrom = 0;
+  std::ptrdiff_t shiftBy = 0;
+  long shiftLines = 0;
+
+  std::size_t beginOf(std::size_t index) const;
+  std::size_t endOf(std::size_t index) const;
+  unsigned int lineOf(std::size_t index) const;
+
+  /// Makes the segments before `index` up to date and those from it on
+  /// stale.
+  void moveShift(std::size_t index);
+
+  /// The last segment that begins at or before `offset`.
+  std::size_t segmentAt(std::size_t offset) const;
+
+  /// Splits the text from `begin` to `end`, which starts on `line`, into
+  /// segments and parses them into `result`. Returns false without parsing
+  /// if `end` is not a statement boundary.
+  bool parse(std::size_t begin, std::size_t end, unsigned int line,
+             std::vector<std::unique_ptr<Segment>>& result) const;
+
+ public:
+  explicit Document(std::string text = "");
+
+  Document(const Document&) = delete;
+  Document& operator=(const Document&) = delete;
+
+  /// Replaces the `length` bytes at `offset` with `replacement`. The range
+  /// is clamped to the text.
+  void edit(std::size_t offset, std::size_t length,
+            const std::string& replacement);
+
+  const std::string& getText() const { return text; }
+
+  /// Whether any segment has syntax errors.
+  bool hadError() const;
+
+  /// The diagnostics of all segments, in order. These include characters
+  /// the scanner skipped, which are not syntax errors.
+  std::string getErrors() const;
+
+  /// Writes the diagnostics to the interpreter's error sink, then runs the
+  /// statements in `interpreter` and calls `finish`. If the text has syntax
+  /// errors, nothing is run. Returns false if there are syntax errors or the
+  /// run ended with a runtime error.
+  bool interpret(Interpreter& interpreter) const;
+
+  /// The top-level statements of all segments, in order.
+  std::vector<const Stmt*> getStatements() const;
+
+  /// The number of top-level segments.
+  std::size_t segmentCount() const { return segments.size(); }
+
+  /// The number of segments parsed by the last edit, or by the constructor.
+  std::size_t lastReparsed() const { return reparsed; }
+};
+
+}  // namespace llox
+
+#endif
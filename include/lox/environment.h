@@ -2,25 +2,67 @@
 #define LLOX_ENVIRONMENT_H
 
 #include <map>
+#include <memory>
+#include <string>
 
+#include "heap.h"
+#include "memory-stats.h"
 #include "object.h"
+#include "region.h"
 
 namespace llox {
 
-class Environment {
-  std::unique_ptr<Environment> enclosing;
-  std::map<std::string, ObjectPtr> values;
+/// The variables of one scope. Lookups that miss continue in the enclosing
+/// scope, which is not owned and must outlive this one.
+///
+/// The locals of a call live on the stack, so environments are counted by
+/// `MemoryStats` as they are constructed rather than allocated.
+class Environment : public RegionAllocated {
+  Environment* enclosing;
+  std::map<std::string, Object*> values;
 
  public:
-  void define(const std::string& name, ObjectPtr value) {
-    values[name] = std::move(value);
+  explicit Environment(Environment* enclosing = nullptr)
+      : enclosing(enclosing) {
+    MemoryStats::allocated(EnvironmentMemory, sizeof(Environment));
+  }
+
+  Environment(const Environment&) = delete;
+  Environment& operator=(const Environment&) = delete;
+
+  ~Environment() {
+    MemoryStats::freed(EnvironmentMemory, sizeof(Environment));
+  }
+
+  void define(const std::string& name, Object* value) { values[name] = value; }
+
+  /// Updates the innermost existing variable called `name`, or defines it
+  /// here if there is none.
+  void assign(const std::string& name, Object* value) {
+    for (Environment* scope = this; scope; scope = scope->enclosing) {
+      auto It = scope->values.find(name);
+      if (It != scope->values.end()) {
+        It->second = value;
+        return;
+      }
+    }
+    define(name, value);
   }
 
   Object* get(const std::string& name) const {
-    auto It = values.find(name);
-    if (It != values.end()) return It->second.get();
+    for (const Environment* scope = this; scope; scope = scope->enclosing) {
+      auto It = scope->values.find(name);
+      if (It != scope->values.end()) return It->second;
+    }
     return nullptr;
   }
+
+  const std::map<std::string, Object*>& getValues() const { return values; }
+
+  /// Marks the variables of this scope only, not of the enclosing ones.
+  void markRoots(Heap& heap) const {
+    for (auto& entry : values) heap.mark(entry.second);
+  }
 };
 
 }  // namespace llox
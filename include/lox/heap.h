@@ -0,0 +1,152 @@
+#ifndef LLOX_HEAP_H
+#define LLOX_HEAP_H
+
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "object.h"
+#include "region.h"
+
+namespace llox {
+
+class Heap;
+
+/// Something that can report the objects it keeps alive to the collector.
+class RootSource {
+ public:
+  virtual ~RootSource() {}
+
+  virtual void markRoots(Heap& heap) = 0;
+};
+
+struct HeapOptions {
+  static constexpr std::size_t kDefaultInitialSize = 1024 * 1024;
+
+  static constexpr double kDefaultGrowthFactor = 2.0;
+
+  std::size_t initialSize = kDefaultInitialSize;
+
+  double growthFactor = kDefaultGrowthFactor;
+
+  /// If set, objects are placed in this region instead and are never
+  /// collected or destroyed.
+  Region* region = nullptr;
+};
+
+struct HeapStats {
+  std::size_t collections = 0;
+  std::size_t objectsAllocated = 0;
+  std::size_t bytesAllocated = 0;
+  std::size_t objectsFreed = 0;
+  std::size_t bytesFreed = 0;
+  std::size_t peakBytes = 0;
+  std::chrono::nanoseconds totalPause{0};
+  std::chrono::nanoseconds maxPause{0};
+};
+
+/// A precise mark-sweep collected heap for runtime objects.
+///
+/// A collection is started by `allocate` once the live size would exceed the
+/// current threshold. Afterwards the threshold is reset to the surviving size
+/// times the growth factor, but never below the initial size.
+///
+/// A heap backed by a region never collects; its objects live until the region
+/// is released.
+class Heap {
+  Object* objects = nullptr;
+
+  std::vector<Object*> grayStack;
+
+  RootSource* roots = nullptr;
+
+  Region* region;
+
+  std::size_t bytesLive = 0;
+
+  std::size_t initialSize;
+
+  std::size_t nextCollection;
+
+  double growthFactor;
+
+  HeapStats stats;
+
+  Nil nilValue;
+
+  Bool trueValue;
+
+  Bool falseValue;
+
+ public:
+  explicit Heap(const HeapOptions& options = HeapOptions())
+      : region(options.region),
+        initialSize(options.initialSize),
+        nextCollection(options.initialSize),
+        growthFactor(options.growthFactor),
+        trueValue(true),
+        falseValue(false) {
+    // The singletons are never swept, so they stay marked for good.
+    nilValue.marked = trueValue.marked = falseValue.marked = true;
+  }
+
+  Heap(const Heap&) = delete;
+  Heap& operator=(const Heap&) = delete;
+
+  ~Heap();
+
+  void setRootSource(RootSource* source) { roots = source; }
+
+  template <typename T, typename... Args>
+  T* allocate(Args&&... args) {
+    if (region) {
+      T* object = new (region->allocate(sizeof(T), alignof(T)))
+          T(std::forward<Args>(args)...);
+      account(object);
+      return object;
+    }
+
+    if (bytesLive + sizeof(T) > nextCollection) collect();
+
+    T* object = new T(std::forward<Args>(args)...);
+    track(object);
+    return object;
+  }
+
+  /// The preallocated `nil`, `true` and `false` values.
+  Nil* nil() { return &nilValue; }
+
+  Bool* boolean(bool value) { return value ? &trueValue : &falseValue; }
+
+  /// Marks `object` as reachable. Null pointers are ignored.
+  void mark(Object* object);
+
+  /// Runs a full collection immediately.
+  void collect();
+
+  /// Flattens `string`, if it is a rope, charging its buffer to the heap.
+  /// This may collect first, so `string` must be reachable from the roots.
+  void flatten(String* string);
+
+  std::size_t liveBytes() const { return bytesLive; }
+
+  const HeapStats& getStats() const { return stats; }
+
+  void printStats(std::ostream& out) const;
+
+ private:
+  void track(Object* object);
+
+  void account(Object* object);
+
+  void traceReferences();
+
+  void sweep();
+};
+
+}  // namespace llox
+
+#endif
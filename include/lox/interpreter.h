@@ -1,53 +1,251 @@
 #ifndef LLOX_INTERPRETER_H
 #define LLOX_INTERPRETER_H
 
+#include <unistd.h>
+
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
 #include "ast.h"
 #include "environment.h"
+#include "heap.h"
 #include "object.h"
+#include "output.h"
+#include "program.h"
 
 namespace llox {
 
-class Interpreter : public ExprVisitor, public StmtVisitor {
-  ObjectPtr value;
+/// Lets the owner of an interpreter share its thread with others. Given one
+/// in `ExecutionBudget`, a running interpreter calls `yield` every so often,
+/// between statements, so a scheduler can block it there while other scripts
+/// run, or stop it.
+class YieldHook {
+ public:
+  virtual ~YieldHook() {}
+
+  /// Returns false to stop the run with an error.
+  virtual bool yield() = 0;
+};
+
+/// Limits on a single run of an interpreter, from its first statement to
+/// `finish`. A run that exceeds one stops with a runtime error. Zero means
+/// no limit.
+///
+/// The limits are enforced at loop back-edges and calls, the only places
+/// a run can spend unbounded time. Time, heap size and `yield` are only
+/// looked at every `Interpreter::kCheckInterval` of those checkpoints, so a
+/// run may overshoot them slightly.
+struct ExecutionBudget {
+  /// The number of statements the run may execute, including those in
+  /// calls.
+  std::size_t maxSteps = 0;
+
+  std::chrono::milliseconds maxTime{0};
+
+  /// The live size of the heap, as counted by `Heap::liveBytes`, after a
+  /// collection.
+  std::size_t maxHeapBytes = 0;
+
+  YieldHook* yield = nullptr;
+};
+
+struct InterpreterOptions {
+  HeapOptions heap;
+
+  /// Where `print` writes. If null, the interpreter buffers its own output to
+  /// stdout.
+  OutputSink* output = nullptr;
+
+  /// Where diagnostics for this interpreter's runs go. If null, they go
+  /// straight to stderr.
+  OutputSink* errors = nullptr;
+
+  /// Print numbers with six fixed decimals, as earlier releases did, instead
+  /// of the shortest representation that round-trips.
+  bool legacyNumberFormat = false;
+
+  ExecutionBudget budget;
+};
+
+class Interpreter : public ExprVisitor,
+                    public StmtVisitor,
+                    public RootSource {
+  Heap heap;
+  Object* value;
+  /// Intermediate results that must survive the evaluation of a sibling.
+  std::vector<Object*> stack;
+  /// The global scope.
   std::unique_ptr<Environment> environment;
+  /// Syntax trees that functions defined here may refer into; see `retain`.
+  std::unordered_set<std::shared_ptr<const void>> retained;
+  /// The innermost scope: the globals, or the locals of the running call.
+  Environment* scope;
+  /// The local scopes of the calls in progress, outermost first.
+  std::vector<Environment*> frames;
+  /// Set by a `return` until the call it leaves has finished.
+  bool returning = false;
+  Object* returnValue = nullptr;
+  /// Set by a runtime error. Nothing more is executed until `finish`.
+  bool halted = false;
+  /// The number of statements run, for tracing and the step budget.
+  std::size_t executed = 0;
+  std::unique_ptr<OutputSink> ownedOutput;
+  OutputSink* output;
+  /// Diagnostics go through `tiedErrors`, which flushes `output` first.
+  std::unique_ptr<TiedOutputSink> tiedErrors;
+  OutputSink* errors;
+  bool legacyNumberFormat;
+  ExecutionBudget budget;
+  /// Set from the first statement of a run until `finish`.
+  bool running = false;
+  /// The run stops once `executed` goes past this.
+  std::size_t stepLimit = std::numeric_limits<std::size_t>::max();
+  std::chrono::steady_clock::time_point deadline;
+  /// Checkpoints left until the budget is checked in full.
+  unsigned int checksLeft = kCheckInterval;
 
  public:
-  Interpreter() : value(nullptr), environment(new Environment()) {}
+  explicit Interpreter(const InterpreterOptions& options = InterpreterOptions())
+      : heap(options.heap),
+        value(nullptr),
+        environment(new Environment()),
+        scope(environment.get()),
+        output(options.output),
+        errors(options.errors ? options.errors : &standardError()),
+        legacyNumberFormat(options.legacyNumberFormat),
+        budget(options.budget) {
+    heap.setRootSource(this);
+    if (!output) {
+      ownedOutput.reset(new FileOutputSink(STDOUT_FILENO));
+      output = ownedOutput.get();
+    }
+    tiedErrors.reset(new TiedOutputSink(*errors, *output));
+    errors = tiedErrors.get();
+  }
+
+  /// Checkpoints between full checks of the time and heap budgets and
+  /// calls to the yield hook.
+  static constexpr unsigned int kCheckInterval = 1024;
+
+  /// Runs `statements` as a script and calls `finish`. Returns false if the
+  /// run ended with a runtime error, including running over budget.
+  bool interpret(const StmtList& statements);
+
+  /// Runs one top-level statement of a script whose statements arrive one
+  /// at a time. Running a list with `interpret` is the same as running each
+  /// of its statements this way and then calling `finish`.
+  void interpret(const Stmt& stmt) {
+    if (!running) beginRun();
+    execute(&stmt);
+  }
 
-  void interpret(StmtList& statements);
+  /// Ends a run: prints the value of the script's trailing expression
+  /// statement, if any, and clears any error so that the next run can start.
+  /// Returns false if the run ended with a runtime error.
+  bool finish();
+
+  bool interpret(const Program& program) {
+    return interpret(program.getStatements());
+  }
+
+  /// Keeps `owner` alive for as long as the interpreter. Statements run from
+  /// a syntax tree that its owner may free, such as a `Document` segment,
+  /// must be retained if they declare functions, which may still be called
+  /// after the tree is gone.
+  void retain(std::shared_ptr<const void> owner) {
+    retained.insert(std::move(owner));
+  }
+
+  /// Writes an image of the global variables to `path`; see `Snapshot`.
+  bool saveSnapshot(const std::string& path) const;
+
+  /// Defines the global variables stored in the image at `path`, as if the
+  /// script that produced it had been run here.
+  bool loadSnapshot(const std::string& path);
+
+  const Heap& getHeap() const { return heap; }
+
+  /// The number of statements run so far, including those in calls.
+  std::size_t statementsExecuted() const { return executed; }
+
+  OutputSink& outputSink() { return *output; }
+
+  OutputSink& errorSink() { return *errors; }
+
+  void markRoots(Heap& heap) override;
 
  private:
-  void execute(Stmt* stmt);
+  /// Reports a runtime error and stops execution.
+  void error(const std::string& message);
+
+  /// Starts counting against the budget.
+  void beginRun();
+
+  /// Stops the run if it is over budget. Called at loop back-edges and
+  /// calls.
+  void checkpoint() {
+    if (executed <= stepLimit && --checksLeft) return;
+    checkBudget();
+  }
+
+  void checkBudget();
+
+  /// Whether `extra` more bytes fit in the heap budget, collecting garbage
+  /// first if that is what it takes. Reports an error if they do not.
+  bool fitsHeapBudget(std::size_t extra);
+
+  /// Flattens `string`, unless its characters would not fit in the heap
+  /// budget.
+  bool flatten(String* string);
+
+  void call(Function* function, const CallExpr* expr);
+
+  /// Runs the statements of a function's body, a `StmtList`. Called through
+  /// the function's `PerfMap` trampoline, if it has one.
+  static void executeBody(void* interpreter, const void* body);
+
+  void execute(const Stmt* stmt);
+
+  Object* evaluate(const Expr* expr);
+
+  /// Compares two values that are both reachable from the roots.
+  bool equal(Object* left, Object* right);
 
-  ObjectPtr evaluate(Expr* expr);
+  /// Prints a value that is reachable from the roots.
+  void print(Object* object);
 
+ protected:
   /// Expressions.
-  void visit(AssignExpr* expr) override;
-  void visit(BinaryExpr* expr) override;
-  void visit(CallExpr* expr) override;
-  void visit(GetExpr* expr) override;
-  void visit(GroupingExpr* expr) override;
-  void visit(BoolLiteralExpr* expr) override;
-  void visit(NilLiteralExpr* expr) override;
-  void visit(NumberLiteralExpr* expr) override;
-  void visit(StringLiteralExpr* expr) override;
-  void visit(LogicalExpr* expr) override;
-  void visit(SetExpr* expr) override;
-  void visit(SuperExpr* expr) override;
-  void visit(ThisExpr* expr) override;
-  void visit(UnaryExpr* expr) override;
-  void visit(VariableExpr* expr) override;
+  void visit(const AssignExpr* expr) override;
+  void visit(const BinaryExpr* expr) override;
+  void visit(const CallExpr* expr) override;
+  void visit(const GetExpr* expr) override;
+  void visit(const GroupingExpr* expr) override;
+  void visit(const BoolLiteralExpr* expr) override;
+  void visit(const NilLiteralExpr* expr) override;
+  void visit(const NumberLiteralExpr* expr) override;
+  void visit(const StringLiteralExpr* expr) override;
+  void visit(const LogicalExpr* expr) override;
+  void visit(const SetExpr* expr) override;
+  void visit(const SuperExpr* expr) override;
+  void visit(const ThisExpr* expr) override;
+  void visit(const UnaryExpr* expr) override;
+  void visit(const VariableExpr* expr) override;
 
   /// Statements.
-  void visit(BlockStmt* stmt) override;
-  void visit(ClassStmt* stmt) override;
-  void visit(ExpressionStmt* stmt) override;
-  void visit(FunctionStmt* stmt) override;
-  void visit(IfStmt* stmt) override;
-  void visit(PrintStmt* stmt) override;
-  void visit(ReturnStmt* stmt) override;
-  void visit(VarStmt* stmt) override;
-  void visit(WhileStmt* stmt) override;
+  void visit(const BlockStmt* stmt) override;
+  void visit(const ClassStmt* stmt) override;
+  void visit(const ExpressionStmt* stmt) override;
+  void visit(const FunctionStmt* stmt) override;
+  void visit(const IfStmt* stmt) override;
+  void visit(const PrintStmt* stmt) override;
+  void visit(const ReturnStmt* stmt) override;
+  void visit(const VarStmt* stmt) override;
+  void visit(const WhileStmt* stmt) override;
 };
 
 }  // namespace llox
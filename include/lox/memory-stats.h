@@ -0,0 +1,108 @@
+#ifndef LLOX_MEMORY_STATS_H
+#define LLOX_MEMORY_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+
+namespace llox {
+
+enum MemoryCategory {
+  TokenMemory,
+  SyntaxTreeMemory,
+  ValueMemory,
+  StringMemory,
+  EnvironmentMemory,
+};
+
+constexpr std::size_t kNumMemoryCategories = EnvironmentMemory + 1;
+
+struct MemoryCategoryStats {
+  std::size_t allocations = 0;
+  std::size_t frees = 0;
+  std::size_t bytesAllocated = 0;
+  std::size_t bytesFreed = 0;
+  std::size_t liveBytes = 0;
+  std::size_t peakBytes = 0;
+};
+
+/// Process-wide counts of the tokens, syntax tree nodes, runtime values,
+/// strings and environments created and destroyed, with their live and peak
+/// sizes. Sizes are those of the objects themselves, or `Object::size` for
+/// runtime values, not of the buffers and containers they own.
+///
+/// Nothing is counted until `enable` is called, so that the counters cost a
+/// single relaxed load otherwise. Objects created before then are still
+/// counted when they are destroyed, so live and peak sizes are only exact if
+/// counting starts before anything is allocated.
+class MemoryStats {
+  static std::atomic<bool> counting;
+
+ public:
+  static void enable();
+
+  static bool isEnabled() { return counting.load(std::memory_order_relaxed); }
+
+  static void allocated(MemoryCategory category, std::size_t bytes) {
+    if (isEnabled()) recordAllocation(category, bytes);
+  }
+
+  static void freed(MemoryCategory category, std::size_t bytes) {
+    if (isEnabled()) recordFree(category, bytes);
+  }
+
+  static MemoryCategoryStats get(MemoryCategory category);
+
+  /// The largest total of live bytes over all categories at any one time.
+  static std::size_t peakBytes();
+
+  /// The number of allocations counted on the calling thread so far.
+  static std::size_t threadAllocations();
+
+  /// Adds an allocation by the global `operator new` to the count of the
+  /// calling thread. Only a binary that replaces `operator new`, such as
+  /// allocation_check, calls this.
+  static void countOperatorNew();
+
+  /// Prints the counters of every category and the peak resident set size
+  /// of the process.
+  static void printStats(std::ostream& out);
+
+ private:
+  static void recordAllocation(MemoryCategory category, std::size_t bytes);
+
+  static void recordFree(MemoryCategory category, std::size_t bytes);
+};
+
+/// For tests: counts the allocations made by the calling thread while it is
+/// in scope, so that a steady-state loop can be held to none. Creating one
+/// enables `MemoryStats` for the rest of the process.
+///
+/// By itself it only sees the objects of the categories above. A container
+/// node, a string buffer or a flattened rope passes unnoticed unless the
+/// binary also counts `operator new` with `MemoryStats::countOperatorNew`,
+/// as allocation_check does; an object of a category is then counted twice.
+class AllocationCheck {
+  std::size_t start;
+
+ public:
+  AllocationCheck() {
+    MemoryStats::enable();
+    start = MemoryStats::threadAllocations();
+  }
+
+  AllocationCheck(const AllocationCheck&) = delete;
+  AllocationCheck& operator=(const AllocationCheck&) = delete;
+
+  std::size_t allocations() const {
+    return MemoryStats::threadAllocations() - start;
+  }
+
+  /// Reports on stderr and aborts if anything was allocated, naming the
+  /// checked code `what`.
+  void assertNone(const char* what) const;
+};
+
+}  // namespace llox
+
+#endif
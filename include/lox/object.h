@@ -1,27 +1,62 @@
 #ifndef LLOX_OBJECT_H
 #define LLOX_OBJECT_H
 
+#include <charconv>
+#include <cstddef>
+#include <string>
+
+#include "pool.h"
+
 namespace llox {
 
+class FunctionStmt;
+class Heap;
+
 enum ObjectKind {
   BoolKind,
   NumberKind,
   NilKind,
   StringKind,
+  FunctionKind,
 };
 
+/// Objects are owned by a `Heap` and reclaimed by its collector, so they are
+/// shared by pointer rather than copied. Their storage comes from the
+/// `ObjectPool`.
 class Object {
+  friend class Heap;
+
+  Object* next = nullptr;
+
+  bool marked = false;
+
  public:
   Object(ObjectKind kind) : kind(kind) {}
 
+  virtual ~Object() {}
+
+  static void* operator new(std::size_t size) {
+    return ObjectPool::allocate(size);
+  }
+
+  static void* operator new(std::size_t size, void* place) { return place; }
+
+  static void operator delete(void* pointer, std::size_t size) {
+    ObjectPool::deallocate(pointer, size);
+  }
+
   virtual bool isTrue() const { return true; }
 
   virtual bool equals(Object* other) const = 0;
 
-  virtual std::unique_ptr<Object> clone() const = 0;
-
   virtual std::string toString() const = 0;
 
+  /// The number of bytes charged against the heap for this object.
+  virtual std::size_t size() const = 0;
+
+  /// Marks every object reachable from this one.
+  virtual void trace(Heap& heap) {}
+
   ObjectKind kind;
 };
 
@@ -36,29 +71,80 @@ class Number : public Object {
     return value == static_cast<Number*>(other)->value;
   }
 
-  std::unique_ptr<Object> clone() const override {
-    return llox::make_unique<Number>(value);
+  /// The shortest representation that reads back as the same value.
+  std::string toString() const override {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    return std::string(buffer, result.ptr);
   }
 
-  std::string toString() const override { return std::to_string(value); }
+  std::size_t size() const override { return sizeof(Number); }
 };
 
+/// A string is either flat or a rope: the deferred concatenation of two other
+/// strings. Ropes are flattened the first time their characters are needed,
+/// which makes building a string by repeated `+` linear rather than
+/// quadratic.
+///
+/// The buffer a rope flattens into is charged to the heap when it is made,
+/// by `Heap::flatten`, rather than up front: the intermediate ropes of a
+/// loop are all reachable from the last one, but are rarely flattened.
 class String : public Object {
+  friend class Heap;
+
+  mutable std::string flat;
+  mutable String* left;
+  mutable String* right;
+  std::size_t length;
+  std::size_t bytes;
+
  public:
-  std::string value;
+  /// Concatenations that would be longer than this fail instead.
+  static constexpr std::size_t kMaxLength = std::size_t(1) << 30;
+
+  String(const std::string& value)
+      : Object(StringKind),
+        flat(value),
+        left(nullptr),
+        right(nullptr),
+        length(value.size()),
+        bytes(sizeof(String) + value.size()) {}
+
+  String(String* left, String* right)
+      : Object(StringKind),
+        left(left),
+        right(right),
+        length(left->length + right->length),
+        bytes(sizeof(String)) {}
+
+  /// The characters of the string, flattening it if necessary. Flatten it
+  /// with `Heap::flatten` first for the buffer to be charged to the heap.
+  const std::string& value() const {
+    if (left) flatten();
+    return flat;
+  }
+
+  std::size_t getLength() const { return length; }
+
+  bool isFlat() const { return !left; }
 
-  String(const std::string& value) : Object(StringKind), value(value) {}
+  /// Appends the characters of the string to `out`, without flattening it.
+  void appendTo(std::string& out) const;
+
+  std::size_t size() const override { return bytes; }
 
   bool equals(Object* other) const override {
     if (other->kind != StringKind) return false;
-    return value == static_cast<String*>(other)->value;
+    const String* string = static_cast<String*>(other);
+    return length == string->length && value() == string->value();
   }
 
-  std::unique_ptr<Object> clone() const override {
-    return llox::make_unique<String>(value);
-  }
+  std::string toString() const override { return value(); }
 
-  std::string toString() const override { return value; }
+  void trace(Heap& heap) override;
+
+ private:
+  void flatten() const;
 };
 
 class Bool : public Object {
@@ -74,11 +160,9 @@ class Bool : public Object {
     return value == static_cast<Bool*>(other)->value;
   }
 
-  std::unique_ptr<Object> clone() const override {
-    return llox::make_unique<Bool>(value);
-  }
-
   std::string toString() const override { return std::to_string(value); }
+
+  std::size_t size() const override { return sizeof(Bool); }
 };
 
 class Nil : public Object {
@@ -89,14 +173,27 @@ class Nil : public Object {
 
   bool equals(Object* other) const override { return other->kind == NilKind; }
 
-  std::unique_ptr<Object> clone() const override {
-    return llox::make_unique<Nil>();
-  }
 
   std::string toString() const override { return "nil"; }
+
+  std::size_t size() const override { return sizeof(Nil); }
 };
 
-typedef std::unique_ptr<Object> ObjectPtr;
+/// A function declared by a script. It refers to its declaration in the
+/// program's AST, so the program must outlive it.
+class Function : public Object {
+ public:
+  const FunctionStmt* declaration;
+
+  Function(const FunctionStmt* declaration)
+      : Object(FunctionKind), declaration(declaration) {}
+
+  bool equals(Object* other) const override { return other == this; }
+
+  std::string toString() const override;
+
+  std::size_t size() const override { return sizeof(Function); }
+};
 
 }  // namespace llox
 
@@ -0,0 +1,101 @@
+#ifndef LLOX_OUTPUT_H
+#define LLOX_OUTPUT_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace llox {
+
+/// A destination for program output.
+class OutputSink {
+ public:
+  virtual ~OutputSink() {}
+
+  virtual void write(const char* data, std::size_t size) = 0;
+
+  void write(const std::string& text) { write(text.data(), text.size()); }
+
+  virtual void flush() {}
+};
+
+/// Buffers output for a file descriptor and writes it with as few system
+/// calls as possible. The buffer is flushed when it fills up, on `flush()`
+/// and on destruction. If the descriptor is a terminal, it is also flushed
+/// after every line so that interactive output appears immediately.
+class FileOutputSink : public OutputSink {
+  int fd;
+  bool lineBuffered;
+  std::unique_ptr<char[]> buffer;
+  std::size_t capacity;
+  std::size_t used = 0;
+  /// The other sinks in existence, for `flushAll`.
+  FileOutputSink* previous = nullptr;
+  FileOutputSink* next = nullptr;
+
+ public:
+  static constexpr std::size_t kDefaultCapacity = 64 * 1024;
+
+  explicit FileOutputSink(int fd, std::size_t capacity = kDefaultCapacity);
+
+  FileOutputSink(const FileOutputSink&) = delete;
+  FileOutputSink& operator=(const FileOutputSink&) = delete;
+
+  ~FileOutputSink() override;
+
+  using OutputSink::write;
+
+  void write(const char* data, std::size_t size) override;
+
+  void flush() override;
+
+  /// Flushes every sink in existence. For fatal errors, where destructors
+  /// will not run; it must not race with writes to the sinks.
+  static void flushAll();
+
+ private:
+  void writeAll(const char* data, std::size_t size);
+};
+
+/// Forwards to another sink, flushing a tied sink before every write, so that
+/// what is written to the two appears in the order it was written even if
+/// the tied sink is buffered. Used to keep diagnostics in order with output.
+class TiedOutputSink : public OutputSink {
+  OutputSink& target;
+  OutputSink& tied;
+
+ public:
+  TiedOutputSink(OutputSink& target, OutputSink& tied)
+      : target(target), tied(tied) {}
+
+  using OutputSink::write;
+
+  void write(const char* data, std::size_t size) override {
+    tied.flush();
+    target.write(data, size);
+  }
+
+  void flush() override { target.flush(); }
+};
+
+/// Collects output in memory.
+class StringOutputSink : public OutputSink {
+  std::string text;
+
+ public:
+  using OutputSink::write;
+
+  void write(const char* data, std::size_t size) override {
+    text.append(data, size);
+  }
+
+  const std::string& str() const { return text; }
+};
+
+/// An unbuffered sink for stderr. It holds no mutable state, so it can be
+/// shared by any number of threads.
+OutputSink& standardError();
+
+}  // namespace llox
+
+#endif
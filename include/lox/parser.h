@@ -4,21 +4,78 @@
 #include <vector>
 
 #include "ast.h"
+#include "output.h"
 #include "scanner.h"
 
 namespace llox {
 
 class Parser {
+  /// What `function` does with the body of a declaration.
+  enum BodyMode {
+    /// Keeps the tokens for `functionBody`, having checked their syntax.
+    CheckBodies,
+    /// Keeps the tokens for `functionBody` without checking them again.
+    DeferBodies,
+  };
+
+  static constexpr std::size_t kNoEnd = static_cast<std::size_t>(-1);
+
   std::unique_ptr<Scanner::TokenList> tokens;
-  unsigned int current = 0;
+  /// Where further tokens come from, if streaming.
+  Scanner* scanner = nullptr;
+  std::size_t current = 0;
+  /// Where `isAtEnd` stops, short of the END token, while a function body is
+  /// checked.
+  std::size_t end = kNoEnd;
+  OutputSink& errors;
+  bool failed = false;
+  /// Set when a function declaration is parsed; cleared by `next`.
+  bool parsedFunction = false;
+  BodyMode bodies = CheckBodies;
+  /// Whether the expression last checked can be assigned to.
+  bool assignable = false;
 
  public:
-  Parser(std::unique_ptr<Scanner::TokenList> tokens)
-      : tokens(std::move(tokens)) {}
+  Parser(std::unique_ptr<Scanner::TokenList> tokens,
+         OutputSink& errors = standardError())
+      : tokens(std::move(tokens)), errors(errors) {}
+
+  /// Parses statements as their tokens are pulled from `scanner`, holding
+  /// on to the tokens of one statement at a time.
+  Parser(Scanner& scanner, OutputSink& errors = standardError())
+      : tokens(new Scanner::TokenList()), scanner(&scanner), errors(errors) {
+    tokens->push_back(scanner.next());
+  }
 
   std::unique_ptr<StmtList> parse();
 
+  /// Parses the next top-level statement, skipping any that have syntax
+  /// errors. Returns null at the end of the input.
+  std::unique_ptr<Stmt> next();
+
+  /// True if the statement last returned by `next` declares a function,
+  /// anywhere within it. Such a statement must be kept for as long as the
+  /// function can be called.
+  bool declaresFunction() const { return parsedFunction; }
+
+  /// The statements of `function`'s body, parsing them first if that has not
+  /// been done yet. Returns null if the body has syntax errors; they are in
+  /// `function.bodyErrors`. Safe to call from several threads at once.
+  ///
+  /// The parser reports syntax errors in a body when it reads the
+  /// declaration, so only a function that did not come from a `Parser` can
+  /// fail here.
+  static const StmtList* functionBody(const FunctionStmt& function);
+
+  /// True if any syntax error was reported. The statements returned by
+  /// `parse` must not be executed in that case.
+  bool hadError() const { return failed; }
+
  private:
+  Parser(std::unique_ptr<Scanner::TokenList> tokens, OutputSink& errors,
+         BodyMode bodies)
+      : tokens(std::move(tokens)), errors(errors), bodies(bodies) {}
+
   template <typename... TokenT>
   bool match(TokenT... tokens);
 
@@ -28,6 +85,8 @@ class Parser {
 
   std::unique_ptr<Stmt> varDeclaration();
 
+  std::unique_ptr<Stmt> function();
+
   std::unique_ptr<Stmt> statement();
 
   std::unique_ptr<Stmt> ifStatement();
@@ -38,10 +97,45 @@ class Parser {
 
   std::unique_ptr<Stmt> printStatement();
 
+  std::unique_ptr<Stmt> returnStatement();
+
   std::unique_ptr<Stmt> expressionStatement();
 
   std::unique_ptr<StmtList> block();
 
+  /// Checks the syntax of the function body between `start` and the `}`
+  /// just consumed, and reports its errors, without building any nodes.
+  void checkBody(std::size_t start);
+
+  bool checkDeclaration();
+
+  bool checkVarDeclaration();
+
+  bool checkFunction();
+
+  bool checkStatement();
+
+  bool checkIfStatement();
+
+  bool checkForStatement();
+
+  bool checkWhileStatement();
+
+  /// The rest of a block whose `{` has been consumed.
+  bool checkBlockBody();
+
+  bool checkExpression();
+
+  bool checkBinary(int level);
+
+  bool matchOperator(int level);
+
+  bool checkUnary();
+
+  bool checkCall();
+
+  bool checkPrimary();
+
   bool check(TokenType type) {
     if (isAtEnd()) return false;
     return peek()->type == type;
@@ -49,10 +143,12 @@ class Parser {
 
   Token* advance() {
     if (!isAtEnd()) current++;
+    if (scanner && current == tokens->size())
+      tokens->push_back(scanner->next());
     return previous();
   }
 
-  bool isAtEnd() const { return peek()->type == END; }
+  bool isAtEnd() const { return current == end || peek()->type == END; }
 
   Token* peek() const { return tokens->at(current).get(); }
 
@@ -85,6 +181,13 @@ class Parser {
   std::unique_ptr<Expr> primary();
 
   bool consume(TokenType type, const std::string& message);
+
+  void synchronize();
+
+  void error(const std::string& message) {
+    failed = true;
+    errors.write("error: " + message + "\n");
+  }
 };
 
 }  // namespace llox
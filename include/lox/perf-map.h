@@ -0,0 +1,46 @@
+#ifndef LLOX_PERF_MAP_H
+#define LLOX_PERF_MAP_H
+
+#include "ast.h"
+
+namespace llox {
+
+/// Names Lox functions in native profiles taken with Linux `perf`.
+///
+/// There is no generated code to symbolize, so instead each Lox function
+/// gets a trampoline of its own: a few instructions of machine code that set
+/// up a frame and call back into the interpreter to run the function's body.
+/// The trampolines are listed in `/tmp/perf-<pid>.map` under the function's
+/// name and line, so that a call stack recorded through them shows which Lox
+/// functions were running between the interpreter's own frames. Walking the
+/// stack through a trampoline needs frame pointers, so the interpreter
+/// should be built with `-fno-omit-frame-pointer` and profiled with
+/// `perf record -g`.
+///
+/// Trampolines are only available on x86-64 and AArch64.
+class PerfMap {
+ public:
+  /// What a trampoline calls, with the arguments it was given.
+  typedef void (*Entry)(void* context, const void* argument);
+
+  typedef void (*Trampoline)(void* context, const void* argument,
+                             Entry entry);
+
+  /// Creates the map file. Must be called before any interpreter runs.
+  /// Returns false if the file cannot be created or the platform has no
+  /// trampolines.
+  static bool open();
+
+  static bool isOpen() { return opened; }
+
+  /// The trampoline of `function`, made and added to the map on first use.
+  /// Returns null if the map is not open or out of memory for trampolines.
+  static Trampoline trampolineFor(const FunctionStmt& function);
+
+ private:
+  static bool opened;
+};
+
+}  // namespace llox
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef LLOX_POOL_H
+#define LLOX_POOL_H
+
+#include <cstddef>
+#include <ostream>
+
+namespace llox {
+
+struct PoolStats {
+  /// Allocations served from a thread's own cache.
+  std::size_t cachedAllocations = 0;
+  /// Times a thread's cache was refilled from the shared free lists.
+  std::size_t refills = 0;
+  /// Calls into the global allocator, for new slabs or oversized requests.
+  std::size_t mallocCalls = 0;
+  std::size_t mallocBytes = 0;
+};
+
+/// A size-class allocator for small runtime objects.
+///
+/// Requests are rounded up to a multiple of `kGranularity` and served from
+/// a per-thread free list for that size class. Empty thread caches are
+/// refilled in batches from shared free lists, which are in turn carved out
+/// of large slabs. Requests larger than `kMaxSize` go straight to the global
+/// allocator. Slab memory is never returned to the system.
+class ObjectPool {
+ public:
+  static constexpr std::size_t kGranularity = 16;
+
+  static constexpr std::size_t kNumSizeClasses = 8;
+
+  static constexpr std::size_t kMaxSize = kGranularity * kNumSizeClasses;
+
+  static constexpr std::size_t kBatchSize = 64;
+
+  static constexpr std::size_t kSlabSize = 64 * 1024;
+
+  static void* allocate(std::size_t size);
+
+  static void deallocate(void* pointer, std::size_t size);
+
+  /// Statistics for the calling thread's cache together with the process-wide
+  /// slow-path counters.
+  static PoolStats stats();
+
+  static void printStats(std::ostream& out);
+};
+
+}  // namespace llox
+
+#endif
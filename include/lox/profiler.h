@@ -0,0 +1,82 @@
+#ifndef LLOX_PROFILER_H
+#define LLOX_PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "interpreter.h"
+#include "output.h"
+
+namespace llox {
+
+/// An interpreter that counts and times the nodes it runs, by source line.
+///
+/// Every statement and expression it visits is counted against its line,
+/// taken from one of its tokens, or against the line of the node that
+/// contains it if it has none. A line's time is inclusive: it runs from
+/// when execution enters the line until it leaves it again, calls made
+/// from it included, and recursion into a line that is already running is
+/// not counted twice. Only the transitions between lines read the clock.
+///
+/// The instrumentation lives entirely in this subclass, so a plain
+/// `Interpreter` pays nothing for it.
+class ProfilingInterpreter : public Interpreter {
+  struct Line {
+    std::uint64_t hits = 0;
+    std::chrono::steady_clock::duration time{0};
+    /// How many times the line is running, through recursion.
+    unsigned int active = 0;
+  };
+
+  std::vector<Line> lines;
+  /// The line of the innermost node running, or 0 outside of any.
+  unsigned int line = 0;
+  std::chrono::steady_clock::duration total{0};
+
+  template <typename Node>
+  void profile(const Node* node, unsigned int nodeLine);
+
+ public:
+  explicit ProfilingInterpreter(
+      const InterpreterOptions& options = InterpreterOptions())
+      : Interpreter(options) {}
+
+  /// Writes the lines that took the most time, and then all of `source`
+  /// with each line's time and hit count beside it.
+  void report(std::string_view source, OutputSink& out) const;
+
+ protected:
+  /// Expressions.
+  void visit(const AssignExpr* expr) override;
+  void visit(const BinaryExpr* expr) override;
+  void visit(const CallExpr* expr) override;
+  void visit(const GetExpr* expr) override;
+  void visit(const GroupingExpr* expr) override;
+  void visit(const BoolLiteralExpr* expr) override;
+  void visit(const NilLiteralExpr* expr) override;
+  void visit(const NumberLiteralExpr* expr) override;
+  void visit(const StringLiteralExpr* expr) override;
+  void visit(const LogicalExpr* expr) override;
+  void visit(const SetExpr* expr) override;
+  void visit(const SuperExpr* expr) override;
+  void visit(const ThisExpr* expr) override;
+  void visit(const UnaryExpr* expr) override;
+  void visit(const VariableExpr* expr) override;
+
+  /// Statements.
+  void visit(const BlockStmt* stmt) override;
+  void visit(const ClassStmt* stmt) override;
+  void visit(const ExpressionStmt* stmt) override;
+  void visit(const FunctionStmt* stmt) override;
+  void visit(const IfStmt* stmt) override;
+  void visit(const PrintStmt* stmt) override;
+  void visit(const ReturnStmt* stmt) override;
+  void visit(const VarStmt* stmt) override;
+  void visit(const WhileStmt* stmt) override;
+};
+
+}  // namespace llox
+
+#endif
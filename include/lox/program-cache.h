@@ -0,0 +1,64 @@
+#ifndef LLOX_PROGRAM_CACHE_H
+#define LLOX_PROGRAM_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "program.h"
+
+namespace llox {
+
+/// Reads and writes compiled programs in the `.loxc` format.
+///
+/// A `.loxc` file is a header followed by the AST flattened in preorder and
+/// a string table. It contains no pointers: children follow their parents
+/// and strings are referenced by offset and length, so the file can be
+/// mapped at any address. The header records the format version, a hash of
+/// the source and the identity of the build that wrote it, and a file whose
+/// key does not match is ignored, since another build of lox may lay out or
+/// run the AST differently.
+class ProgramCache {
+ public:
+  /// Bumped whenever the AST or the encoding changes.
+  static constexpr std::uint32_t kFormatVersion = 2;
+
+  /// A 64-bit FNV-1a hash of `source`.
+  static std::uint64_t hashSource(std::string_view source);
+
+  /// Identifies this build of lox: a hash of the executable's GNU build ID,
+  /// or of the executable itself if it has none.
+  static std::uint64_t buildIdentity();
+
+  /// Flattens `program` into the `.loxc` format. Function bodies that have
+  /// not been parsed yet are parsed first; if any of them has syntax errors,
+  /// the result is empty.
+  static std::string serialize(const Program& program,
+                               std::uint64_t sourceHash);
+
+  /// Flattens `statements` as by `serialize`, as if they made up a program.
+  static std::string serialize(const std::vector<const Stmt*>& statements,
+                               std::uint64_t sourceHash);
+
+  /// Rebuilds a program from `size` bytes of `.loxc` data. Returns null if
+  /// the data is malformed or was produced for a different source, format or
+  /// build.
+  static std::unique_ptr<const Program> deserialize(const char* data,
+                                                    std::size_t size,
+                                                    std::uint64_t sourceHash);
+
+  /// Maps the `.loxc` file at `path` and loads it as by `deserialize`.
+  static std::unique_ptr<const Program> load(const std::string& path,
+                                             std::uint64_t sourceHash);
+
+  /// Writes `program` to `path`, atomically replacing any existing file.
+  /// Returns false without writing if `program` cannot be serialized.
+  static bool store(const Program& program, std::uint64_t sourceHash,
+                    const std::string& path);
+};
+
+}  // namespace llox
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef LLOX_PROGRAM_H
+#define LLOX_PROGRAM_H
+
+#include <memory>
+#include <string>
+
+#include "ast.h"
+#include "output.h"
+#include "source-buffer.h"
+
+namespace llox {
+
+class ThreadPool;
+
+/// A compiled script.
+///
+/// A program is immutable once compiled. Interpreters only read it and keep
+/// all per-run state, including any caches, in themselves, so a single
+/// program can be executed by any number of interpreters on different
+/// threads at once. Share it with `std::shared_ptr<const Program>`.
+class Program {
+  std::unique_ptr<StmtList> statements;
+
+ public:
+  explicit Program(std::unique_ptr<StmtList> statements)
+      : statements(std::move(statements)) {}
+
+  Program(const Program&) = delete;
+  Program& operator=(const Program&) = delete;
+
+  /// Scans and parses `source`. Syntax errors are reported to `errors`, in
+  /// which case null is returned.
+  static std::unique_ptr<const Program> compile(
+      const std::string& source, OutputSink& errors = standardError());
+
+  static std::unique_ptr<const Program> compile(
+      const SourceBuffer& source, OutputSink& errors = standardError());
+
+  /// Like `compile`, but splits a large source at top-level statement
+  /// boundaries and scans and parses the pieces on `pool`. The result is the
+  /// same as that of `compile`. If any piece has an error, the whole source
+  /// is compiled again sequentially, so that the diagnostics are too. Must
+  /// not be called from a task running on `pool`.
+  static std::unique_ptr<const Program> compile(
+      const SourceBuffer& source, ThreadPool& pool,
+      OutputSink& errors = standardError());
+
+  const StmtList& getStatements() const { return *statements; }
+};
+
+}  // namespace llox
+
+#endif
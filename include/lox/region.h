@@ -0,0 +1,106 @@
+#ifndef LLOX_REGION_H
+#define LLOX_REGION_H
+
+#include <cstddef>
+
+#include "memory-stats.h"
+
+namespace llox {
+
+/// A bump allocator. Memory handed out by a region is never freed on its
+/// own; all of it is released at once when the region is destroyed, and the
+/// destructors of objects placed in it are never run.
+class Region {
+  struct Chunk {
+    Chunk* next;
+    std::size_t size;
+    std::size_t used;
+  };
+
+  /// Chunk headers are padded so that chunk data is maximally aligned.
+  static constexpr std::size_t kHeaderSize =
+      (sizeof(Chunk) + alignof(std::max_align_t) - 1) &
+      ~(alignof(std::max_align_t) - 1);
+
+  Chunk* chunks = nullptr;
+
+  std::size_t nextChunkSize;
+
+  std::size_t bytesUsed = 0;
+
+  std::size_t bytesReserved = 0;
+
+ public:
+  static constexpr std::size_t kDefaultChunkSize = 64 * 1024;
+
+  static constexpr std::size_t kMaxChunkSize = 64 * 1024 * 1024;
+
+  explicit Region(std::size_t chunkSize = kDefaultChunkSize)
+      : nextChunkSize(chunkSize) {}
+
+  Region(const Region&) = delete;
+  Region& operator=(const Region&) = delete;
+
+  ~Region();
+
+  void* allocate(std::size_t size,
+                 std::size_t alignment = alignof(std::max_align_t));
+
+  /// Returns true if `pointer` was handed out by this region.
+  bool contains(const void* pointer) const;
+
+  std::size_t used() const { return bytesUsed; }
+
+  std::size_t reserved() const { return bytesReserved; }
+
+  /// The region that `RegionAllocated` classes allocate from on this thread,
+  /// or null if they should use the global allocator.
+  static Region* active();
+
+ private:
+  Chunk* grow(std::size_t minimumSize);
+};
+
+/// Makes a region the active one on this thread for the lifetime of the
+/// scope. Objects allocated from it must not be deleted after the scope ends.
+class RegionScope {
+  Region* previous;
+
+ public:
+  explicit RegionScope(Region* region);
+
+  RegionScope(const RegionScope&) = delete;
+  RegionScope& operator=(const RegionScope&) = delete;
+
+  ~RegionScope();
+};
+
+/// Base class for types that are allocated from the active region, if any.
+/// Deleting an instance that lives in the active region only runs its
+/// destructor; the memory is reclaimed with the region.
+class RegionAllocated {
+ public:
+  static void* operator new(std::size_t size);
+
+  static void operator delete(void* pointer);
+};
+
+/// A `RegionAllocated` base whose instances are counted by `MemoryStats`
+/// under `category`.
+template <MemoryCategory category>
+class CountedRegionAllocated : public RegionAllocated {
+ public:
+  static void* operator new(std::size_t size) {
+    MemoryStats::allocated(category, size);
+    return RegionAllocated::operator new(size);
+  }
+
+  static void operator delete(void* pointer, std::size_t size) {
+    MemoryStats::freed(category, size);
+    RegionAllocated::operator delete(pointer);
+  }
+};
+
+}  // namespace llox
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef LLOX_SAMPLER_H
+#define LLOX_SAMPLER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+#include "ast.h"
+#include "output.h"
+
+namespace llox {
+
+/// A Lox call that is running: the function, and the line of the call.
+struct ShadowFrame {
+  const FunctionStmt* function;
+  unsigned int line;
+};
+
+/// The Lox calls running on one thread, innermost last.
+///
+/// Interpreters push and pop their calls here so that `Sampler` can read
+/// the stack from a signal handler that interrupts them. A frame is written
+/// before the depth that covers it is raised, and the depth is lowered
+/// before its frame is reused, so the handler always sees whole frames.
+/// Calls nested deeper than `kCapacity` are counted but not recorded.
+///
+/// Each thread's stack is constant-initialized, so the handler can reach it
+/// on any thread, including one that has never made a Lox call, without
+/// running an initializer or allocating.
+class ShadowStack {
+ public:
+  static constexpr std::size_t kCapacity = 1024;
+
+  constexpr ShadowStack() {}
+
+  /// The stack of the calling thread.
+  static ShadowStack& current();
+
+  void push(const FunctionStmt* function, unsigned int line) {
+    std::size_t top = depth.load(std::memory_order_relaxed);
+    if (top < kCapacity) frames[top] = {function, line};
+    std::atomic_signal_fence(std::memory_order_release);
+    depth.store(top + 1, std::memory_order_relaxed);
+  }
+
+  void pop() {
+    depth.store(depth.load(std::memory_order_relaxed) - 1,
+                std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_release);
+  }
+
+ private:
+  friend class Sampler;
+
+  ShadowFrame frames[kCapacity] = {};
+  std::atomic<std::size_t> depth{0};
+};
+
+/// A statistical profiler of Lox call stacks.
+///
+/// While started, a `SIGPROF` timer interrupts whichever thread is using
+/// the CPU every `interval` of CPU time, and the signal handler copies that
+/// thread's `ShadowStack` into a buffer allocated up front. It takes no
+/// locks and allocates nothing. Samples that do not fit in the buffer are
+/// dropped and counted. As signals are process-wide, so is the sampler.
+/// The kernel delivers the signal at most once per scheduler tick, so the
+/// actual rate may be lower than asked for.
+class Sampler {
+ public:
+  static constexpr std::chrono::microseconds kDefaultInterval{1000};
+
+  /// Starts sampling. Returns false if the timer or the handler cannot be
+  /// set up, or if the sampler is already running.
+  static bool start(std::chrono::microseconds interval = kDefaultInterval);
+
+  /// Stops sampling and folds the samples into stacks of function names.
+  /// Must be called while the programs that ran are still alive, as the
+  /// samples refer to their functions.
+  static void stop();
+
+  /// Writes the stacks folded by `stop` in the collapsed format read by
+  /// flamegraph.pl: one line per distinct stack, frames from the outermost
+  /// on, separated by `;`, then a space and the number of samples. Each
+  /// frame but the innermost is followed by the line of the call it made.
+  static void write(OutputSink& out);
+
+ private:
+  static void handleSignal(int);
+};
+
+}  // namespace llox
+
+#endif
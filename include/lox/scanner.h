@@ -1,10 +1,14 @@
 #ifndef LLOX_SCANNER_H
 #define LLOX_SCANNER_H
 
+#include <istream>
 #include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "output.h"
+#include "source-buffer.h"
 #include "token.h"
 #include "util.h"
 
@@ -17,42 +21,69 @@ class Scanner {
   typedef std::vector<std::unique_ptr<Token>> TokenList;
 
  private:
-  std::string source;
+  /// The text being scanned. It is not copied, so it must outlive the
+  /// scanner. When streaming, it is a view of `window`.
+  std::string_view source;
+
+  /// When streaming, the part of the input read so far that starts at or
+  /// before the current token.
+  std::string window;
+
+  /// Where more text comes from, if streaming.
+  std::istream* input = nullptr;
 
   std::unique_ptr<TokenList> tokens;
 
-  std::map<std::string, TokenType> keywords;
+  OutputSink& errors;
 
-  unsigned int start = 0;
+  std::size_t start = 0;
 
-  unsigned int current = 0;
+  std::size_t current = 0;
 
   unsigned int line = 1;
 
+  std::size_t scanned = 0;
+
  public:
-  Scanner(const std::string& source) : source(source) {
+  Scanner(const SourceBuffer& source, OutputSink& errors = standardError())
+      : source(source.view()), errors(errors) {
+    tokens.reset(new TokenList());
+  }
+
+  Scanner(const std::string& source, OutputSink& errors = standardError())
+      : source(source), errors(errors) {
     tokens.reset(new TokenList());
+  }
+
+  /// Scans a fragment of a larger text, numbering lines from `line`.
+  Scanner(std::string_view source, unsigned int line, OutputSink& errors)
+      : source(source), errors(errors), line(line) {
+    tokens.reset(new TokenList());
+  }
 
-    keywords["and"] = TokenType::AND;
-    keywords["class"] = TokenType::CLASS;
-    keywords["else"] = ELSE;
-    keywords["false"] = FALSE;
-    keywords["for"] = FOR;
-    keywords["fun"] = FUN;
-    keywords["if"] = IF;
-    keywords["nil"] = NIL;
-    keywords["or"] = OR;
-    keywords["print"] = PRINT;
-    keywords["return"] = RETURN;
-    keywords["super"] = SUPER;
-    keywords["this"] = THIS;
-    keywords["true"] = TRUE;
-    keywords["var"] = VAR;
-    keywords["while"] = WHILE;
+  /// Scans `input` incrementally, reading it a chunk at a time as tokens
+  /// are requested with `next`.
+  Scanner(std::istream& input, OutputSink& errors = standardError())
+      : input(&input), errors(errors) {
+    tokens.reset(new TokenList());
   }
 
+  static constexpr std::size_t kChunkSize = 64 * 1024;
+
   std::unique_ptr<TokenList> scanTokens();
 
+  /// Scans and returns the next token, or an `END` token once the input is
+  /// exhausted. Text before the returned token is discarded, so memory use
+  /// does not grow with the length of the input.
+  std::unique_ptr<Token> next();
+
+  /// The number of tokens scanned so far, not counting `END`.
+  std::size_t tokenCount() const { return scanned; }
+
+  /// The value of a number literal, whatever the locale. Literals too large
+  /// for a double are infinite, and those too small are zero.
+  static double numberValue(std::string_view lexeme);
+
  private:
   void scanToken();
 
@@ -62,17 +93,20 @@ class Scanner {
   }
 
   void addToken(TokenType type) {
-    std::string text = source.substr(start, current - start);
+    scanned += 1;
+    std::string text(source.substr(start, current - start));
     tokens->push_back(llox::make_unique<Token>(type, text, line));
   }
 
   void addStringToken(const std::string& literal) {
-    std::string text = source.substr(start, current - start);
+    scanned += 1;
+    std::string text(source.substr(start, current - start));
     tokens->push_back(llox::make_unique<StringToken>(text, line, literal));
   }
 
   void addNumberToken(double literal) {
-    std::string text = source.substr(start, current - start);
+    scanned += 1;
+    std::string text(source.substr(start, current - start));
     tokens->push_back(llox::make_unique<NumberToken>(text, line, literal));
   }
 
@@ -82,10 +116,21 @@ class Scanner {
 
   bool isAlphaNumeric(char c) { return isAlpha(c) || isDigit(c); }
 
-  bool isAtEnd() const { return current >= source.size(); }
+  bool isAtEnd() { return !available(1); }
 
   bool isDigit(char c) const { return c >= '0' && c <= '9'; }
 
+  /// True if `count` characters are available from the current one on,
+  /// reading more of the input if necessary.
+  bool available(std::size_t count) {
+    while (source.size() - current < count)
+      if (!fill()) return false;
+    return true;
+  }
+
+  /// Appends the next chunk of the input to the window, if there is any.
+  bool fill();
+
   bool match(char expected) {
     if (isAtEnd()) return false;
     if (source[current] != expected) return false;
@@ -96,12 +141,12 @@ class Scanner {
   }
 
   char peek() {
-    if (current >= source.size()) return '\0';
+    if (!available(1)) return '\0';
     return source[current];
   }
 
   char peekNext() {
-    if (current + 1 >= source.size()) return '\0';
+    if (!available(2)) return '\0';
     return source[current + 1];
   }
 
@@ -110,6 +155,8 @@ class Scanner {
   void number();
 
   void identifier();
+
+  void error() { errors.write("error\n"); }
 };
 
 }  // namespace llox
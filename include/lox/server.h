@@ -0,0 +1,160 @@
+#ifndef LLOX_SERVER_H
+#define LLOX_SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "interpreter.h"
+#include "output.h"
+#include "program.h"
+#include "source-buffer.h"
+#include "thread-pool.h"
+
+namespace llox {
+
+/// The protocol between `Server` and `Client`.
+///
+/// Every message is a frame: a one-byte type, a four-byte payload length in
+/// host byte order, then the payload. A client sends a `RunFrame` holding the
+/// source of a script. The server answers with any number of `OutputFrame`s
+/// and `ErrorFrame`s, carrying what the script printed to stdout and stderr,
+/// and then an `ExitFrame` holding a four-byte exit status. A connection can
+/// carry any number of such exchanges, one after another.
+enum FrameType : std::uint8_t {
+  RunFrame = 'r',
+  OutputFrame = 'o',
+  ErrorFrame = 'e',
+  ExitFrame = 'x',
+};
+
+/// The exit status of a script with syntax errors.
+constexpr std::uint32_t kSyntaxErrorStatus = 65;
+
+/// The exit status of a script stopped by a runtime error, including running
+/// over its budget.
+constexpr std::uint32_t kRuntimeErrorStatus = 70;
+
+/// The exit status sent on a connection that the server turns away, without
+/// running its script, because it is serving as many as it can.
+constexpr std::uint32_t kBusyStatus = 75;
+
+bool writeFrame(int fd, FrameType type, const char* data, std::size_t size);
+
+/// Reads one frame. Returns false on end of input or a malformed frame.
+bool readFrame(int fd, FrameType& type, std::string& payload);
+
+struct ServerOptions {
+  /// Options for the interpreter that runs each request. Its sinks are
+  /// replaced by the connection.
+  InterpreterOptions interpreter;
+
+  /// Worker threads, as for `ThreadPool`. Each request occupies one while it
+  /// compiles and runs.
+  unsigned jobs = 0;
+
+  /// How long a connection may wait for the client to send its next frame,
+  /// or to take output it has sent, before it is closed. Zero waits forever.
+  std::chrono::milliseconds timeout = std::chrono::seconds(60);
+
+  /// Connections served at once. Each one takes a thread and the memory for
+  /// the frames it sends; further ones are answered with `kBusyStatus`.
+  unsigned maxConnections = 64;
+};
+
+/// Runs scripts sent over a Unix domain socket.
+///
+/// The server stays up between requests, so its worker threads, their object
+/// pool caches and the compiled programs it has seen stay warm. Programs are
+/// cached by source text and shared by every request that runs them; each
+/// request still gets a fresh interpreter.
+///
+/// Each connection has a thread of its own that waits for its frames and
+/// hands the scripts to the worker pool, so clients that connect and then
+/// sit idle do not hold up the others. The number of connections is capped
+/// by `ServerOptions::maxConnections`.
+class Server {
+  static constexpr std::size_t kMaxCachedPrograms = 1024;
+
+  struct CachedProgram {
+    std::string source;
+    std::shared_ptr<const Program> program;
+    /// Where the program's hash is in `recent`.
+    std::list<std::uint64_t>::iterator use;
+  };
+
+  ServerOptions options;
+
+  ThreadPool pool;
+
+  std::mutex cacheLock;
+
+  std::unordered_map<std::uint64_t, CachedProgram> cache;
+
+  /// The hashes of the cached programs, most recently used first. The last
+  /// one is evicted when the cache is full.
+  std::list<std::uint64_t> recent;
+
+  int listener = -1;
+
+  /// The connections being served.
+  std::atomic<unsigned> connections{0};
+
+ public:
+  explicit Server(const ServerOptions& options = ServerOptions());
+
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+  ~Server();
+
+  /// Binds the socket at `path`, replacing a socket file left there by an
+  /// earlier server. Fails if `path` is some other kind of file.
+  bool listen(const std::string& path);
+
+  /// Accepts and serves connections until the listening socket fails. The
+  /// server must outlive the connections still open when it returns.
+  void serve();
+
+ private:
+  /// Tells the client at `fd` that the server is busy.
+  void reject(int fd);
+
+  void handle(int fd);
+
+  /// Runs one script on a worker and writes its output and exit status.
+  /// Returns false if the connection failed.
+  bool run(int fd, const std::string& source);
+
+  std::shared_ptr<const Program> compile(const std::string& source,
+                                         OutputSink& errors);
+};
+
+/// The client side of a `Server` connection.
+class Client {
+  int fd = -1;
+
+ public:
+  Client() {}
+
+  Client(const Client&) = delete;
+  Client& operator=(const Client&) = delete;
+
+  ~Client();
+
+  bool connect(const std::string& path);
+
+  /// Runs `source` on the server, writing what it prints to `output` and
+  /// `errors` as it arrives. Returns the exit status, or -1 if the
+  /// connection failed.
+  int run(const SourceBuffer& source, OutputSink& output, OutputSink& errors);
+};
+
+}  // namespace llox
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef LLOX_SNAPSHOT_H
+#define LLOX_SNAPSHOT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "environment.h"
+#include "heap.h"
+#include "program.h"
+
+namespace llox {
+
+/// Reads and writes images of the global environment.
+///
+/// An image lists every object bound to a global, each followed by the names
+/// bound to it, so objects shared between globals stay shared. Characters are
+/// stored by offset into a string table, and ropes are stored flattened.
+/// Functions are stored as their declarations, which follow the string table
+/// as an embedded `.loxc` program; see `ProgramCache`.
+/// Loading maps the file, checks it, then rebuilds the objects and bindings
+/// in a single pass without running any code.
+class Snapshot {
+ public:
+  /// Bumped whenever the object model or the encoding changes.
+  static constexpr std::uint32_t kFormatVersion = 2;
+
+  /// Encodes the bindings in `globals`. Returns an empty string if a bound
+  /// function cannot be serialized.
+  static std::string serialize(const Environment& globals);
+
+  /// Allocates the objects of a `size`-byte image in `heap` and binds them in
+  /// `globals`. The functions among them refer into `declarations`, which
+  /// must outlive them. Returns false, having changed nothing, if the image
+  /// is malformed or was written by a different format version, or holds
+  /// functions and was written by a different build.
+  static bool deserialize(const char* data, std::size_t size, Heap& heap,
+                          Environment& globals,
+                          std::unique_ptr<const Program>& declarations);
+
+  /// Writes the image of `globals` to `path`, atomically replacing any
+  /// existing file.
+  static bool save(const Environment& globals, const std::string& path);
+
+  /// Maps the image at `path` and loads it as by `deserialize`.
+  static bool load(const std::string& path, Heap& heap, Environment& globals,
+                   std::unique_ptr<const Program>& declarations);
+};
+
+}  // namespace llox
+
+#endif
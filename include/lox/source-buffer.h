@@ -0,0 +1,55 @@
+#ifndef LLOX_SOURCE_BUFFER_H
+#define LLOX_SOURCE_BUFFER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace llox {
+
+/// The text of a script.
+///
+/// A regular file is mapped into memory rather than read, so loading it
+/// costs no copying and its pages are shared with the page cache. Anything
+/// that cannot be mapped, such as a pipe, is read into memory instead. A
+/// mapped file must not be truncated while the buffer is alive.
+class SourceBuffer {
+  const char* bytes = nullptr;
+  std::size_t length = 0;
+  void* mapping = nullptr;
+  /// The size of `mapping`, which may start before `bytes`.
+  std::size_t mappingSize = 0;
+  std::string owned;
+
+ public:
+  /// A buffer holding `text` itself.
+  explicit SourceBuffer(std::string text);
+
+  SourceBuffer(const SourceBuffer&) = delete;
+  SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+  ~SourceBuffer();
+
+  /// Maps or reads the file at `path`. Returns null if it cannot be opened.
+  static std::unique_ptr<SourceBuffer> open(const char* path);
+
+  /// Maps or reads everything left in `fd`, from its current offset on, and
+  /// leaves the offset at the end. Returns null on a read error.
+  static std::unique_ptr<SourceBuffer> read(int fd);
+
+  const char* data() const { return bytes; }
+
+  std::size_t size() const { return length; }
+
+  std::string_view view() const { return std::string_view(bytes, length); }
+
+  bool isMapped() const { return mapping != nullptr; }
+
+ private:
+  SourceBuffer() {}
+};
+
+}  // namespace llox
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef LLOX_SPLITTER_H
+#define LLOX_SPLITTER_H
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace llox {
+
+/// A run of whole top-level statements and the line it starts on.
+struct SourcePiece {
+  std::string_view text;
+  unsigned int line;
+};
+
+/// Splits `source`, which starts on `line`, into pieces of about `target`
+/// bytes each. The pieces are contiguous and cover all of `source`.
+///
+/// A piece ends after a `;` or `}` outside of any braces, parentheses,
+/// string or comment, unless the next word is `else`, which would continue
+/// an `if` statement. Only lines are counted, so this is much cheaper than
+/// scanning. Unbalanced source is not split any further once it goes wrong,
+/// and the parse of the piece holding the error then fails.
+///
+/// If `rest` is not null, it is set to the offset just past the last
+/// boundary, which is the size of `source` if it ends at one.
+std::vector<SourcePiece> splitStatements(std::string_view source,
+                                         std::size_t target,
+                                         unsigned int line = 1,
+                                         std::size_t* rest = nullptr);
+
+/// Whether `source` holds nothing but blanks and `//` comments.
+bool isBlank(std::string_view source);
+
+/// Whether `source` starts, past any blanks and comments, with an `else`,
+/// so that a statement boundary right before it would split an `if`.
+bool startsWithElse(std::string_view source);
+
+}  // namespace llox
+
+#endif
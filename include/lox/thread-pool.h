@@ -0,0 +1,73 @@
+#ifndef LLOX_THREAD_POOL_H
+#define LLOX_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace llox {
+
+/// A fixed set of worker threads with one task deque each.
+///
+/// A worker runs tasks from the back of its own deque and, when that is
+/// empty, steals from the front of the others. Tasks submitted from outside
+/// the pool are spread over the deques round-robin; tasks submitted by a
+/// worker go to its own deque.
+class ThreadPool {
+  struct Worker {
+    std::mutex lock;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+
+  std::vector<std::thread> threads;
+
+  std::mutex idleLock;
+
+  std::condition_variable wake;
+
+  std::condition_variable done;
+
+  /// Tasks sitting in a deque.
+  std::size_t queued = 0;
+
+  /// Tasks submitted but not yet finished.
+  std::atomic<std::size_t> pending{0};
+
+  std::atomic<std::size_t> nextWorker{0};
+
+  bool stopping = false;
+
+ public:
+  /// Starts `size` workers, or one per hardware thread if `size` is zero.
+  explicit ThreadPool(unsigned size = 0);
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /// Finishes every submitted task, then stops the workers.
+  ~ThreadPool();
+
+  void submit(std::function<void()> task);
+
+  /// Blocks until every task submitted so far has finished.
+  void wait();
+
+  unsigned size() const { return threads.size(); }
+
+ private:
+  void work(std::size_t index);
+
+  bool take(std::size_t index, std::function<void()>& task);
+};
+
+}  // namespace llox
+
+#endif
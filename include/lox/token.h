@@ -3,6 +3,7 @@
 
 #include <string>
 
+#include "region.h"
 #include "util.h"
 
 namespace llox {
@@ -58,7 +59,7 @@ enum TokenType {
   END
 };
 
-class Token {
+class Token : public CountedRegionAllocated<TokenMemory> {
  public:
   TokenType type;
   std::string lexeme;
@@ -67,6 +68,8 @@ class Token {
   Token(TokenType type, const std::string& lexeme, unsigned int line)
       : type(type), lexeme(lexeme), line(line) {}
 
+  virtual ~Token() {}
+
   virtual std::unique_ptr<Token> clone() const {
     return llox::make_unique<Token>(type, lexeme, line);
   }
@@ -0,0 +1,90 @@
+#ifndef LLOX_TRACE_H
+#define LLOX_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace llox {
+
+/// A process-wide timeline of spans, written in the Chrome trace-event JSON
+/// format that `about://tracing` and Perfetto load.
+///
+/// Nothing is recorded until `start` is called. Spans may end on any
+/// thread; each thread gets its own track.
+class Trace {
+  static std::atomic<bool> recording;
+
+ public:
+  /// Begins recording spans.
+  static void start();
+
+  static bool isRecording() {
+    return recording.load(std::memory_order_relaxed);
+  }
+
+  /// Stops recording and writes everything recorded to `path`. Returns
+  /// false if the file cannot be written.
+  static bool write(const std::string& path);
+
+ private:
+  friend class TraceSpan;
+
+  struct Arg {
+    const char* name;
+    std::uint64_t value;
+  };
+
+  static constexpr std::size_t kMaxArgs = 4;
+
+  static void record(const char* name,
+                     std::chrono::steady_clock::time_point start,
+                     std::chrono::steady_clock::time_point end,
+                     const Arg* args, std::size_t argCount);
+};
+
+/// Records the time from its construction to its destruction as a span
+/// named `name`, which must be a string literal, if the trace is recording.
+/// Up to four counters can be attached to it with `arg`.
+class TraceSpan {
+  const char* name;
+  std::chrono::steady_clock::time_point start;
+  Trace::Arg args[Trace::kMaxArgs];
+  std::size_t argCount = 0;
+  bool active;
+
+ public:
+  explicit TraceSpan(const char* name)
+      : name(name), active(Trace::isRecording()) {
+    if (active) start = std::chrono::steady_clock::now();
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+  ~TraceSpan() {
+    if (active)
+      Trace::record(name, start, std::chrono::steady_clock::now(), args,
+                    argCount);
+  }
+
+  void arg(const char* key, std::uint64_t value) {
+    if (active && argCount < Trace::kMaxArgs) args[argCount++] = {key, value};
+  }
+};
+
+}  // namespace llox
+
+/// Use these rather than `TraceSpan` itself: building with
+/// `-DLLOX_NO_TRACING` removes them, and every span with them.
+#ifndef LLOX_NO_TRACING
+#define LLOX_TRACE_SPAN(span, name) ::llox::TraceSpan span(name)
+#define LLOX_TRACE_ARG(span, key, value) (span).arg(key, value)
+#else
+#define LLOX_TRACE_SPAN(span, name)
+#define LLOX_TRACE_ARG(span, key, value)
+#endif
+
+#endif
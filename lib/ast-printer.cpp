@@ -2,55 +2,57 @@
 
 using namespace llox;
 
-std::string AstPrinter::print(StmtList& statements) {
+std::string AstPrinter::print(const StmtList& statements) {
   for (auto& stmt : statements) stmt->accept(*this);
   return representation;
 }
 
-void AstPrinter::visit(AssignExpr* expr) {
+void AstPrinter::visit(const AssignExpr* expr) {
   parenthesize("= " + expr->name->lexeme, expr->value.get());
 }
 
-void AstPrinter::visit(BinaryExpr* expr) {
+void AstPrinter::visit(const BinaryExpr* expr) {
   parenthesize(expr->op->lexeme, expr->left.get(), expr->right.get());
 }
 
-void AstPrinter::visit(CallExpr* expr) {
-  std::vector<Expr*> exprs;
+void AstPrinter::visit(const CallExpr* expr) {
+  std::vector<const Expr*> exprs;
   exprs.push_back(expr->callee.get());
   for (auto& expr : expr->arguments) exprs.push_back(expr.get());
   parenthesize("call", exprs);
 }
 
-void AstPrinter::visit(GetExpr* expr) {
+void AstPrinter::visit(const GetExpr* expr) {
   representation.append("(. ");
   expr->object->accept(*this);
   representation.append(" " + expr->name->lexeme + ")");
 }
 
-void AstPrinter::visit(GroupingExpr* expr) {
+void AstPrinter::visit(const GroupingExpr* expr) {
   parenthesize("group", expr->expression.get());
 }
 
-void AstPrinter::visit(BoolLiteralExpr* expr) {
+void AstPrinter::visit(const BoolLiteralExpr* expr) {
   representation.append(std::to_string(expr->value));
 }
 
-void AstPrinter::visit(NilLiteralExpr* expr) { representation.append("nil"); }
+void AstPrinter::visit(const NilLiteralExpr* expr) {
+  representation.append("nil");
+}
 
-void AstPrinter::visit(NumberLiteralExpr* expr) {
+void AstPrinter::visit(const NumberLiteralExpr* expr) {
   representation.append(std::to_string(expr->value));
 }
 
-void AstPrinter::visit(StringLiteralExpr* expr) {
+void AstPrinter::visit(const StringLiteralExpr* expr) {
   representation.append(expr->value);
 }
 
-void AstPrinter::visit(LogicalExpr* expr) {
+void AstPrinter::visit(const LogicalExpr* expr) {
   parenthesize(expr->op->lexeme, expr->left.get(), expr->right.get());
 }
 
-void AstPrinter::visit(SetExpr* expr) {
+void AstPrinter::visit(const SetExpr* expr) {
   representation.append("(= ");
   expr->object->accept(*this);
   representation.append(" " + expr->name->lexeme + " ");
@@ -58,36 +60,36 @@ void AstPrinter::visit(SetExpr* expr) {
   representation.append(")\n");
 }
 
-void AstPrinter::visit(SuperExpr* expr) {
+void AstPrinter::visit(const SuperExpr* expr) {
   representation.append("(super " + expr->method->lexeme + ")");
 }
 
-void AstPrinter::visit(ThisExpr* expr) { representation.append("this"); }
+void AstPrinter::visit(const ThisExpr* expr) { representation.append("this"); }
 
-void AstPrinter::visit(UnaryExpr* expr) {
+void AstPrinter::visit(const UnaryExpr* expr) {
   parenthesize(expr->op->lexeme, expr->right.get());
 }
 
-void AstPrinter::visit(VariableExpr* expr) {
+void AstPrinter::visit(const VariableExpr* expr) {
   representation.append(expr->name->lexeme);
 }
 
-void AstPrinter::visit(BlockStmt* stmt) {
+void AstPrinter::visit(const BlockStmt* stmt) {
   representation.append("(block\n");
   for (auto& stmt : stmt->statements) stmt->accept(*this);
   representation.append(")\n");
 }
 
-void AstPrinter::visit(ClassStmt* stmt) {}
+void AstPrinter::visit(const ClassStmt* stmt) {}
 
-void AstPrinter::visit(ExpressionStmt* stmt) {
+void AstPrinter::visit(const ExpressionStmt* stmt) {
   parenthesize(";", stmt->expression.get());
   representation.append("\n");
 }
 
-void AstPrinter::visit(FunctionStmt* stmt) {}
+void AstPrinter::visit(const FunctionStmt* stmt) {}
 
-void AstPrinter::visit(IfStmt* stmt) {
+void AstPrinter::visit(const IfStmt* stmt) {
   if (!stmt->elseBranch) {
     representation.append("(if ");
     stmt->condition->accept(*this);
@@ -104,14 +106,14 @@ void AstPrinter::visit(IfStmt* stmt) {
   representation.append(")\n");
 }
 
-void AstPrinter::visit(PrintStmt* stmt) {
+void AstPrinter::visit(const PrintStmt* stmt) {
   parenthesize("print", stmt->expression.get());
   representation.append("\n");
 }
 
-void AstPrinter::visit(ReturnStmt* stmt) {}
+void AstPrinter::visit(const ReturnStmt* stmt) {}
 
-void AstPrinter::visit(VarStmt* stmt) {
+void AstPrinter::visit(const VarStmt* stmt) {
   representation.append("(var " + stmt->name->lexeme);
   if (stmt->initializer) {
     representation.append(" = ");
@@ -120,7 +122,7 @@ void AstPrinter::visit(VarStmt* stmt) {
   representation.append(")\n");
 }
 
-void AstPrinter::visit(WhileStmt* stmt) {
+void AstPrinter::visit(const WhileStmt* stmt) {
   representation.append("(while ");
   stmt->condition->accept(*this);
   representation.append("\n");
@@ -129,7 +131,7 @@ void AstPrinter::visit(WhileStmt* stmt) {
 
 template <typename... ExprT>
 std::string AstPrinter::parenthesize(const std::string& name, ExprT... exprs) {
-  std::vector<Expr*> exprvec = {exprs...};
+  std::vector<const Expr*> exprvec = {exprs...};
   return parenthesize(name, exprvec);
 }
 
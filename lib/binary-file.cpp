@@ -0,0 +1,50 @@
+#include "lox/binary-file.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+using namespace llox;
+
+bool llox::writeFileAtomically(const std::string& path,
+                               const std::string& contents) {
+  std::string temporary = path + ".tmp." + std::to_string(getpid());
+  FILE* file = std::fopen(temporary.c_str(), "wb");
+  if (!file) return false;
+  bool written = std::fwrite(contents.data(), 1, contents.size(), file) ==
+                 contents.size();
+  written = std::fclose(file) == 0 && written;
+  if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+void BinaryWriter::string(const std::string& value) {
+  auto inserted = offsets.emplace(value, strings.size());
+  if (inserted.second) strings.append(value);
+  u32(inserted.first->second);
+  u32(value.size());
+}
+
+void BinaryReader::raw(void* value, std::size_t length) {
+  if (!valid || size - position < length) {
+    valid = false;
+    std::memset(value, 0, length);
+    return;
+  }
+  std::memcpy(value, bytes + position, length);
+  position += length;
+}
+
+std::string BinaryReader::string() {
+  std::uint32_t offset = u32();
+  std::uint32_t length = u32();
+  if (!valid || offset > stringsSize || stringsSize - offset < length) {
+    valid = false;
+    return std::string();
+  }
+  return std::string(strings + offset, length);
+}
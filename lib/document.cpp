@@ -0,0 +1,209 @@
+#include "lox/document.h"
+
+#include <algorithm>
+#include <iterator>
+#include <string_view>
+
+#include "lox/parser.h"
+#include "lox/scanner.h"
+#include "lox/splitter.h"
+
+using namespace llox;
+
+namespace {
+
+/// Whether the last line of the blank `text` is a comment, which would run
+/// on into whatever follows it.
+bool endsInComment(std::string_view text) {
+  std::size_t newline = text.rfind('\n');
+  if (newline != std::string_view::npos) text.remove_prefix(newline + 1);
+  return text.find('/') != std::string_view::npos;
+}
+
+}  // namespace
+
+Document::Document(std::string text) : text(std::move(text)) {
+  parse(0, this->text.size(), 1, segments);
+  reparsed = segments.size();
+}
+
+std::size_t Document::beginOf(std::size_t index) const {
+  return segments[index]->begin + (index < shiftFrom ? 0 : shiftBy);
+}
+
+std::size_t Document::endOf(std::size_t index) const {
+  return segments[index]->end + (index < shiftFrom ? 0 : shiftBy);
+}
+
+unsigned int Document::lineOf(std::size_t index) const {
+  return segments[index]->line + (index < shiftFrom ? 0 : shiftLines);
+}
+
+void Document::moveShift(std::size_t index) {
+  if (shiftBy == 0 && shiftLines == 0) {
+    shiftFrom = index;
+    return;
+  }
+  for (; shiftFrom < index; ++shiftFrom) {
+    Segment& segment = *segments[shiftFrom];
+    segment.begin += shiftBy;
+    segment.end += shiftBy;
+    segment.line += shiftLines;
+  }
+  for (; shiftFrom > index; --shiftFrom) {
+    Segment& segment = *segments[shiftFrom - 1];
+    segment.begin -= shiftBy;
+    segment.end -= shiftBy;
+    segment.line -= shiftLines;
+  }
+}
+
+std::size_t Document::segmentAt(std::size_t offset) const {
+  std::size_t low = 0;
+  std::size_t high = segments.size();
+  while (high - low > 1) {
+    std::size_t middle = low + (high - low) / 2;
+    if (beginOf(middle) <= offset)
+      low = middle;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+bool Document::parse(std::size_t begin, std::size_t end, unsigned int line,
+                     std::vector<std::unique_ptr<Segment>>& result) const {
+  std::string_view source = std::string_view(text).substr(begin, end - begin);
+  std::size_t rest;
+  std::vector<SourcePiece> pieces = splitStatements(source, 1, line, &rest);
+
+  // Unless nothing follows, whatever comes after the last boundary has to
+  // be blank, and what follows must neither continue a comment nor start an
+  // `else` that belongs to the last statement.
+  bool blank = isBlank(source.substr(rest));
+  if (end < text.size() &&
+      (!blank || endsInComment(source.substr(rest)) ||
+       startsWithElse(std::string_view(text).substr(end))))
+    return false;
+
+  // A blank tail stays with the statement before it.
+  if (pieces.size() > 1 && rest < source.size() && blank) pieces.pop_back();
+
+  for (std::size_t index = 0; index < pieces.size(); ++index) {
+    std::unique_ptr<Segment> segment(new Segment());
+    segment->begin = begin + (pieces[index].text.data() - source.data());
+    segment->end = index + 1 < pieces.size()
+                       ? segment->begin + pieces[index].text.size()
+                       : end;
+    segment->line = pieces[index].line;
+
+    StringOutputSink errors;
+    Scanner scanner(source.substr(segment->begin - begin,
+                                  segment->end - segment->begin),
+                    segment->line, errors);
+    Parser parser(scanner, errors);
+    segment->statements = std::make_shared<StmtList>();
+    segment->functions = false;
+    while (std::unique_ptr<Stmt> stmt = parser.next()) {
+      segment->functions = segment->functions || parser.declaresFunction();
+      segment->statements->push_back(std::move(stmt));
+    }
+    // As in a full parse, stray characters are reported by the scanner but
+    // do not stop the statements from running.
+    segment->failed = parser.hadError();
+    segment->errors = errors.str();
+    result.push_back(std::move(segment));
+  }
+  return true;
+}
+
+void Document::edit(std::size_t offset, std::size_t length,
+                    const std::string& replacement) {
+  offset = std::min(offset, text.size());
+  length = std::min(length, text.size() - offset);
+
+  // The segments that hold the edited range. An edit that ends on a
+  // boundary may join the segment after it.
+  std::size_t first = segmentAt(offset);
+  std::size_t last = segmentAt(offset + length);
+
+  long lines = std::count(replacement.begin(), replacement.end(), '\n') -
+               std::count(text.begin() + offset,
+                          text.begin() + offset + length, '\n');
+  std::ptrdiff_t delta = static_cast<std::ptrdiff_t>(replacement.size()) -
+                         static_cast<std::ptrdiff_t>(length);
+  text.replace(offset, length, replacement);
+
+  // An `else` that now starts the first segment joins it to the one before.
+  if (first > 0 && startsWithElse(std::string_view(text).substr(
+                       beginOf(first))))
+    first -= 1;
+
+  // Take in the following segments until the new text ends at a boundary.
+  // Blanks that are left on their own go with the statement after them, or
+  // with the one before them at the end of the text, as they would in a
+  // full parse.
+  std::vector<std::unique_ptr<Segment>> result;
+  std::size_t next = last + 1;
+  std::size_t end = endOf(last) + delta;
+  for (;;) {
+    std::size_t begin = beginOf(first);
+    if (isBlank(std::string_view(text).substr(begin, end - begin))) {
+      if (end < text.size()) {
+        end = endOf(next++) + delta;
+        continue;
+      }
+      if (first > 0) {
+        first -= 1;
+        continue;
+      }
+    }
+    if (parse(begin, end, lineOf(first), result)) break;
+    end = endOf(next++) + delta;
+  }
+
+  moveShift(next);
+  shiftBy += delta;
+  shiftLines += lines;
+
+  reparsed = result.size();
+  if (result.size() == next - first) {
+    std::move(result.begin(), result.end(), segments.begin() + first);
+  } else {
+    segments.erase(segments.begin() + first, segments.begin() + next);
+    segments.insert(segments.begin() + first,
+                    std::make_move_iterator(result.begin()),
+                    std::make_move_iterator(result.end()));
+    shiftFrom = first + result.size();
+  }
+}
+
+bool Document::hadError() const {
+  for (const auto& segment : segments)
+    if (segment->failed) return true;
+  return false;
+}
+
+std::string Document::getErrors() const {
+  std::string errors;
+  for (const auto& segment : segments) errors += segment->errors;
+  return errors;
+}
+
+std::vector<const Stmt*> Document::getStatements() const {
+  std::vector<const Stmt*> statements;
+  for (const auto& segment : segments)
+    for (const auto& stmt : *segment->statements)
+      statements.push_back(stmt.get());
+  return statements;
+}
+
+bool Document::interpret(Interpreter& interpreter) const {
+  interpreter.errorSink().write(getErrors());
+  if (hadError()) return false;
+  for (const auto& segment : segments) {
+    if (segment->functions) interpreter.retain(segment->statements);
+    for (const auto& stmt : *segment->statements) interpreter.interpret(*stmt);
+  }
+  return interpreter.finish();
+}
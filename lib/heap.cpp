@@ -0,0 +1,162 @@
+#include "lox/heap.h"
+
+#include <algorithm>
+
+#include "lox/ast.h"
+#include "lox/memory-stats.h"
+#include "lox/trace.h"
+
+using namespace llox;
+
+namespace {
+
+MemoryCategory categoryOf(const Object* object) {
+  return object->kind == StringKind ? StringMemory : ValueMemory;
+}
+
+}  // namespace
+
+Heap::~Heap() {
+  while (objects) {
+    Object* next = objects->next;
+    MemoryStats::freed(categoryOf(objects), objects->size());
+    delete objects;
+    objects = next;
+  }
+}
+
+std::string Function::toString() const {
+  return "<fn " + declaration->name->lexeme + ">";
+}
+
+void String::trace(Heap& heap) {
+  heap.mark(left);
+  heap.mark(right);
+}
+
+void String::flatten() const {
+  std::string result;
+  result.reserve(length);
+  appendTo(result);
+  flat.swap(result);
+  left = right = nullptr;
+}
+
+void String::appendTo(std::string& out) const {
+  // Ropes built in a loop are deeply left-leaning, so walk them with an
+  // explicit stack instead of recursing.
+  std::vector<const String*> pending;
+  pending.push_back(this);
+  while (!pending.empty()) {
+    const String* string = pending.back();
+    pending.pop_back();
+    if (string->left) {
+      pending.push_back(string->right);
+      pending.push_back(string->left);
+    } else {
+      out.append(string->flat);
+    }
+  }
+}
+
+void Heap::mark(Object* object) {
+  if (!object || object->marked) return;
+  object->marked = true;
+  grayStack.push_back(object);
+}
+
+void Heap::collect() {
+  if (region) return;
+
+  LLOX_TRACE_SPAN(span, "gc");
+  [[maybe_unused]] std::size_t freedBefore = stats.objectsFreed;
+  auto start = std::chrono::steady_clock::now();
+
+  if (roots) roots->markRoots(*this);
+  traceReferences();
+  sweep();
+
+  nextCollection = std::max(
+      initialSize, static_cast<std::size_t>(bytesLive * growthFactor));
+
+  auto pause = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start);
+  stats.collections += 1;
+  stats.totalPause += pause;
+  stats.maxPause = std::max(stats.maxPause, pause);
+  LLOX_TRACE_ARG(span, "freed", stats.objectsFreed - freedBefore);
+  LLOX_TRACE_ARG(span, "bytes live", bytesLive);
+}
+
+void Heap::flatten(String* string) {
+  if (string->isFlat()) return;
+
+  std::size_t size = string->length;
+  if (!region && bytesLive + size > nextCollection) collect();
+
+  string->flatten();
+  string->bytes += size;
+  bytesLive += size;
+  stats.bytesAllocated += size;
+  stats.peakBytes = std::max(stats.peakBytes, bytesLive);
+  MemoryStats::allocated(StringMemory, size);
+}
+
+void Heap::printStats(std::ostream& out) const {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+
+  out << "gc: collections: " << stats.collections << "\n"
+      << "gc: objects allocated: " << stats.objectsAllocated << "\n"
+      << "gc: bytes allocated: " << stats.bytesAllocated << "\n"
+      << "gc: objects freed: " << stats.objectsFreed << "\n"
+      << "gc: bytes freed: " << stats.bytesFreed << "\n"
+      << "gc: peak live bytes: " << stats.peakBytes << "\n"
+      << "gc: total pause: "
+      << duration_cast<microseconds>(stats.totalPause).count() << "us\n"
+      << "gc: max pause: "
+      << duration_cast<microseconds>(stats.maxPause).count() << "us\n";
+}
+
+void Heap::track(Object* object) {
+  object->next = objects;
+  objects = object;
+  account(object);
+}
+
+void Heap::account(Object* object) {
+  std::size_t size = object->size();
+  bytesLive += size;
+  stats.objectsAllocated += 1;
+  stats.bytesAllocated += size;
+  stats.peakBytes = std::max(stats.peakBytes, bytesLive);
+  MemoryStats::allocated(categoryOf(object), size);
+}
+
+void Heap::traceReferences() {
+  while (!grayStack.empty()) {
+    Object* object = grayStack.back();
+    grayStack.pop_back();
+    object->trace(*this);
+  }
+}
+
+void Heap::sweep() {
+  Object** link = &objects;
+  while (*link) {
+    Object* object = *link;
+    if (object->marked) {
+      object->marked = false;
+      link = &object->next;
+      continue;
+    }
+
+    *link = object->next;
+    std::size_t size = object->size();
+    bytesLive -= size;
+    stats.objectsFreed += 1;
+    stats.bytesFreed += size;
+    MemoryStats::freed(categoryOf(object), size);
+    delete object;
+  }
+}
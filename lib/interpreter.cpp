@@ -1,164 +1,396 @@
 #include "lox/interpreter.h"
 
 #include <cmath>
-#include <iostream>
+#include <string>
+
+#include "lox/parser.h"
+#include "lox/perf-map.h"
+#include "lox/sampler.h"
+#include "lox/snapshot.h"
+#include "lox/trace.h"
 
 using namespace llox;
 
-void Interpreter::interpret(StmtList& statements) {
+bool Interpreter::interpret(const StmtList& statements) {
+  LLOX_TRACE_SPAN(span, "interpret");
+  if (!running) beginRun();
+  [[maybe_unused]] std::size_t executedBefore = executed;
+  [[maybe_unused]] std::size_t allocatedBefore =
+      heap.getStats().objectsAllocated;
+
   for (auto& stmt : statements) execute(stmt.get());
 
-  if (value) {
-    std::cout << value->toString() << std::endl;
+  LLOX_TRACE_ARG(span, "statements", executed - executedBefore);
+  LLOX_TRACE_ARG(span, "allocations",
+                 heap.getStats().objectsAllocated - allocatedBefore);
+
+  return finish();
+}
+
+bool Interpreter::finish() {
+  if (value && !halted) print(value);
+  bool completed = !halted;
+  value = nullptr;
+  // A `return` outside of any function or a runtime error ends the run, but
+  // the next one starts afresh.
+  returning = false;
+  returnValue = nullptr;
+  halted = false;
+  running = false;
+  return completed;
+}
+
+void Interpreter::beginRun() {
+  running = true;
+  stepLimit = budget.maxSteps ? executed + budget.maxSteps
+                              : std::numeric_limits<std::size_t>::max();
+  deadline = std::chrono::steady_clock::now() + budget.maxTime;
+  checksLeft = kCheckInterval;
+}
+
+void Interpreter::checkBudget() {
+  checksLeft = kCheckInterval;
+  if (halted) return;
+
+  if (executed > stepLimit) {
+    error("Exceeded the step budget of " + std::to_string(budget.maxSteps) +
+          " statements.");
+    return;
   }
+  if (budget.maxTime.count() && std::chrono::steady_clock::now() > deadline) {
+    error("Exceeded the time budget of " +
+          std::to_string(budget.maxTime.count()) + "ms.");
+    return;
+  }
+  if (!fitsHeapBudget(0)) return;
+  if (budget.yield && !budget.yield->yield()) error("Stopped by the host.");
+}
+
+bool Interpreter::fitsHeapBudget(std::size_t extra) {
+  if (!budget.maxHeapBytes || heap.liveBytes() + extra <= budget.maxHeapBytes)
+    return true;
+  heap.collect();
+  if (heap.liveBytes() + extra <= budget.maxHeapBytes) return true;
+  error("Exceeded the heap budget of " + std::to_string(budget.maxHeapBytes) +
+        " bytes.");
+  return false;
 }
 
-void Interpreter::execute(Stmt* stmt) { stmt->accept(*this); }
+bool Interpreter::flatten(String* string) {
+  // A rope costs little until it is flattened, however long it is, so the
+  // checkpoints cannot see this allocation coming.
+  if (string->isFlat()) return true;
+  if (halted || !fitsHeapBudget(string->getLength())) return false;
+  heap.flatten(string);
+  return true;
+}
+
+bool Interpreter::saveSnapshot(const std::string& path) const {
+  return Snapshot::save(*environment, path);
+}
+
+bool Interpreter::loadSnapshot(const std::string& path) {
+  std::unique_ptr<const Program> declarations;
+  if (!Snapshot::load(path, heap, *environment, declarations)) return false;
+  retain(std::shared_ptr<const Program>(std::move(declarations)));
+  return true;
+}
+
+void Interpreter::markRoots(Heap& heap) {
+  heap.mark(value);
+  heap.mark(returnValue);
+  for (Object* object : stack) heap.mark(object);
+  environment->markRoots(heap);
+  for (Environment* frame : frames) frame->markRoots(heap);
+}
 
-ObjectPtr Interpreter::evaluate(Expr* expr) {
+void Interpreter::error(const std::string& message) {
+  errors->write("error: " + message + "\n");
+  halted = true;
+}
+
+// Statements left after a `return` or an error are skipped rather than
+// unwound, so every loop over statements also stops here.
+void Interpreter::execute(const Stmt* stmt) {
+  if (returning || halted) return;
+  executed += 1;
+  stmt->accept(*this);
+}
+
+// A call can halt the run in the middle of an expression, which leaves the
+// operands around it without values, so a halted run evaluates to nil.
+Object* Interpreter::evaluate(const Expr* expr) {
+  if (halted) return heap.nil();
   expr->accept(*this);
-  return std::move(value);
+  Object* result = value;
+  value = nullptr;
+  return halted ? heap.nil() : result;
+}
+
+bool Interpreter::equal(Object* left, Object* right) {
+  // Strings of different lengths are unequal without being flattened.
+  if (left->kind == StringKind && right->kind == StringKind &&
+      static_cast<String*>(left)->getLength() ==
+          static_cast<String*>(right)->getLength()) {
+    if (!flatten(static_cast<String*>(left)) ||
+        !flatten(static_cast<String*>(right)))
+      return false;
+  }
+  return left->equals(right);
+}
+
+void Interpreter::print(Object* object) {
+  if (object->kind == StringKind && !flatten(static_cast<String*>(object)))
+    return;
+  std::string text;
+  if (legacyNumberFormat && object->kind == NumberKind)
+    text = std::to_string(static_cast<Number*>(object)->value);
+  else
+    text = object->toString();
+  text.push_back('\n');
+  output->write(text);
 }
 
-void Interpreter::visit(AssignExpr* expr) {
+void Interpreter::visit(const AssignExpr* expr) {
   value = evaluate(expr->value.get());
-  environment->define(expr->name->lexeme, value->clone());
+  scope->assign(expr->name->lexeme, value);
 }
 
-void Interpreter::visit(BinaryExpr* expr) {
-  ObjectPtr left = ObjectPtr(evaluate(expr->left.get()));
-  ObjectPtr right = ObjectPtr(evaluate(expr->right.get()));
+void Interpreter::visit(const BinaryExpr* expr) {
+  Object* left = evaluate(expr->left.get());
+  if (halted) {
+    value = heap.nil();
+    return;
+  }
+  stack.push_back(left);
+  Object* right = evaluate(expr->right.get());
+  if (halted) {
+    stack.pop_back();
+    value = heap.nil();
+    return;
+  }
+  // Both operands stay rooted until the result is allocated, since a
+  // concatenation keeps references to them.
+  stack.push_back(right);
 
   switch (expr->op->type) {
     case GREATER: {
-      double leftValue = static_cast<Number*>(left.get())->value;
-      double rightValue = static_cast<Number*>(right.get())->value;
-      value.reset(new Bool(leftValue > rightValue));
+      double leftValue = static_cast<Number*>(left)->value;
+      double rightValue = static_cast<Number*>(right)->value;
+      value = heap.boolean(leftValue > rightValue);
       break;
     }
     case GREATER_EQUAL: {
-      double leftValue = static_cast<Number*>(left.get())->value;
-      double rightValue = static_cast<Number*>(right.get())->value;
-      value.reset(new Bool(leftValue >= rightValue));
+      double leftValue = static_cast<Number*>(left)->value;
+      double rightValue = static_cast<Number*>(right)->value;
+      value = heap.boolean(leftValue >= rightValue);
       break;
     }
     case LESS: {
-      double leftValue = static_cast<Number*>(left.get())->value;
-      double rightValue = static_cast<Number*>(right.get())->value;
-      value.reset(new Bool(leftValue < rightValue));
+      double leftValue = static_cast<Number*>(left)->value;
+      double rightValue = static_cast<Number*>(right)->value;
+      value = heap.boolean(leftValue < rightValue);
       break;
     }
     case LESS_EQUAL: {
-      double leftValue = static_cast<Number*>(left.get())->value;
-      double rightValue = static_cast<Number*>(right.get())->value;
-      value.reset(new Bool(leftValue <= rightValue));
+      double leftValue = static_cast<Number*>(left)->value;
+      double rightValue = static_cast<Number*>(right)->value;
+      value = heap.boolean(leftValue <= rightValue);
       break;
     }
     case BANG_EQUAL: {
-      value.reset(new Bool(!left->equals(right.get())));
+      value = heap.boolean(!equal(left, right));
       break;
     }
     case EQUAL_EQUAL: {
-      value.reset(new Bool(left->equals(right.get())));
+      value = heap.boolean(equal(left, right));
       break;
     }
     case MINUS: {
-      double leftValue = static_cast<Number*>(left.get())->value;
-      double rightValue = static_cast<Number*>(right.get())->value;
-      value.reset(new Number(leftValue - rightValue));
+      double leftValue = static_cast<Number*>(left)->value;
+      double rightValue = static_cast<Number*>(right)->value;
+      value = heap.allocate<Number>(leftValue - rightValue);
       break;
     }
     case PLUS: {
       if (left->kind == NumberKind && right->kind == NumberKind) {
-        double leftValue = static_cast<Number*>(left.get())->value;
-        double rightValue = static_cast<Number*>(right.get())->value;
-        value.reset(new Number(leftValue + rightValue));
+        double leftValue = static_cast<Number*>(left)->value;
+        double rightValue = static_cast<Number*>(right)->value;
+        value = heap.allocate<Number>(leftValue + rightValue);
       }
 
       if (left->kind == StringKind && right->kind == StringKind) {
-        const std::string& leftValue = static_cast<String*>(left.get())->value;
-        const std::string& rightValue =
-            static_cast<String*>(right.get())->value;
-        value.reset(new String(leftValue + rightValue));
+        String* leftString = static_cast<String*>(left);
+        String* rightString = static_cast<String*>(right);
+        std::size_t length = leftString->getLength() + rightString->getLength();
+        if (length < leftString->getLength() || length > String::kMaxLength) {
+          error("Strings longer than " + std::to_string(String::kMaxLength) +
+                " characters are not supported.");
+          value = heap.nil();
+          break;
+        }
+        value = heap.allocate<String>(leftString, rightString);
       }
 
       break;
     }
     case SLASH: {
-      double leftValue = static_cast<Number*>(left.get())->value;
-      double rightValue = static_cast<Number*>(right.get())->value;
-      value.reset(new Number(leftValue / rightValue));
+      double leftValue = static_cast<Number*>(left)->value;
+      double rightValue = static_cast<Number*>(right)->value;
+      value = heap.allocate<Number>(leftValue / rightValue);
       break;
     }
     case STAR: {
-      double leftValue = static_cast<Number*>(left.get())->value;
-      double rightValue = static_cast<Number*>(right.get())->value;
-      value.reset(new Number(leftValue * rightValue));
+      double leftValue = static_cast<Number*>(left)->value;
+      double rightValue = static_cast<Number*>(right)->value;
+      value = heap.allocate<Number>(leftValue * rightValue);
       break;
     }
     case PERCENT: {
-      double leftValue = static_cast<Number*>(left.get())->value;
-      double rightValue = static_cast<Number*>(right.get())->value;
-      value.reset(new Number(std::fmod(leftValue, rightValue)));
+      double leftValue = static_cast<Number*>(left)->value;
+      double rightValue = static_cast<Number*>(right)->value;
+      value = heap.allocate<Number>(std::fmod(leftValue, rightValue));
       break;
     }
     default:
       break;
   }
+
+  stack.pop_back();
+  stack.pop_back();
+}
+
+void Interpreter::visit(const CallExpr* expr) {
+  Object* callee = evaluate(expr->callee.get());
+  if (halted) {
+    value = heap.nil();
+    return;
+  }
+  if (!callee || callee->kind != FunctionKind) {
+    error("Can only call functions and classes.");
+    value = heap.nil();
+    return;
+  }
+
+  stack.push_back(callee);
+  call(static_cast<Function*>(callee), expr);
+  stack.pop_back();
+}
+
+void Interpreter::call(Function* function, const CallExpr* expr) {
+  const FunctionStmt* declaration = function->declaration;
+  value = heap.nil();
+
+  if (expr->arguments.size() != declaration->parameters.size()) {
+    error("Expected " + std::to_string(declaration->parameters.size()) +
+          " arguments but got " + std::to_string(expr->arguments.size()) +
+          ".");
+    return;
+  }
+
+  const StmtList* body = Parser::functionBody(*declaration);
+  if (!body) {
+    errors->write(declaration->bodyErrors);
+    halted = true;
+    return;
+  }
+
+  // Arguments stay rooted on the stack until they are bound.
+  std::size_t base = stack.size();
+  for (auto& argument : expr->arguments)
+    stack.push_back(evaluate(argument.get()));
+  if (halted) {
+    stack.resize(base);
+    value = heap.nil();
+    return;
+  }
+
+  // Functions see their own locals and the globals.
+  Environment locals(environment.get());
+  for (std::size_t index = 0; index < declaration->parameters.size(); ++index)
+    locals.define(declaration->parameters[index]->lexeme, stack[base + index]);
+  stack.resize(base);
+
+  Environment* enclosing = scope;
+  scope = &locals;
+  frames.push_back(&locals);
+  checkpoint();
+  ShadowStack& shadow = ShadowStack::current();
+  shadow.push(declaration, expr->paren->line);
+  PerfMap::Trampoline trampoline =
+      PerfMap::isOpen() ? PerfMap::trampolineFor(*declaration) : nullptr;
+  if (trampoline)
+    trampoline(this, body, executeBody);
+  else
+    executeBody(this, body);
+  shadow.pop();
+  frames.pop_back();
+  scope = enclosing;
+
+  value = returnValue ? returnValue : heap.nil();
+  returning = false;
+  returnValue = nullptr;
 }
 
-void Interpreter::visit(CallExpr* expr) {}
+void Interpreter::executeBody(void* interpreter, const void* body) {
+  Interpreter* self = static_cast<Interpreter*>(interpreter);
+  for (auto& stmt : *static_cast<const StmtList*>(body))
+    self->execute(stmt.get());
+}
 
-void Interpreter::visit(GetExpr* expr) {}
+void Interpreter::visit(const GetExpr* expr) {}
 
-void Interpreter::visit(GroupingExpr* expr) {
+void Interpreter::visit(const GroupingExpr* expr) {
   value = evaluate(expr->expression.get());
 }
 
-void Interpreter::visit(BoolLiteralExpr* expr) {
-  value.reset(new Bool(expr->value));
+void Interpreter::visit(const BoolLiteralExpr* expr) {
+  value = heap.boolean(expr->value);
 }
 
-void Interpreter::visit(NilLiteralExpr* expr) { value.reset(new Nil()); }
+void Interpreter::visit(const NilLiteralExpr* expr) { value = heap.nil(); }
 
-void Interpreter::visit(NumberLiteralExpr* expr) {
-  value.reset(new Number(expr->value));
+void Interpreter::visit(const NumberLiteralExpr* expr) {
+  value = heap.allocate<Number>(expr->value);
 }
 
-void Interpreter::visit(StringLiteralExpr* expr) {
-  value.reset(new String(expr->value));
+void Interpreter::visit(const StringLiteralExpr* expr) {
+  value = heap.allocate<String>(expr->value);
 }
 
-void Interpreter::visit(LogicalExpr* expr) {
-  ObjectPtr left = ObjectPtr(evaluate(expr->left.get()));
+void Interpreter::visit(const LogicalExpr* expr) {
+  value = evaluate(expr->left.get());
+  if (halted) return;
 
-  if (expr->op->type == OR && !left->isTrue()) {
+  if (expr->op->type == OR && !value->isTrue()) {
     value = evaluate(expr->right.get());
-  }
-
-  if (expr->op->type == AND && left->isTrue()) {
+  } else if (expr->op->type == AND && value->isTrue()) {
     value = evaluate(expr->right.get());
   }
 }
 
-void Interpreter::visit(SetExpr* expr) {}
+void Interpreter::visit(const SetExpr* expr) {}
 
-void Interpreter::visit(SuperExpr* expr) {}
+void Interpreter::visit(const SuperExpr* expr) {}
 
-void Interpreter::visit(ThisExpr* expr) {}
+void Interpreter::visit(const ThisExpr* expr) {}
 
-void Interpreter::visit(UnaryExpr* expr) {
-  ObjectPtr right = ObjectPtr(evaluate(expr->right.get()));
+void Interpreter::visit(const UnaryExpr* expr) {
+  Object* right = evaluate(expr->right.get());
+  if (halted) {
+    value = heap.nil();
+    return;
+  }
 
   switch (expr->op->type) {
     case BANG: {
-      Bool* result = static_cast<Bool*>(right.get());
-      value.reset(new Bool(!result->isTrue()));
+      Bool* result = static_cast<Bool*>(right);
+      value = heap.boolean(!result->isTrue());
       break;
     }
     case MINUS: {
-      Number* result = static_cast<Number*>(right.get());
-      value.reset(new Number(-result->value));
+      Number* result = static_cast<Number*>(right);
+      value = heap.allocate<Number>(-result->value);
       break;
     }
     default:
@@ -166,25 +398,31 @@ void Interpreter::visit(UnaryExpr* expr) {
   }
 }
 
-void Interpreter::visit(VariableExpr* expr) {
-  value = environment->get(expr->name->lexeme)->clone();
+void Interpreter::visit(const VariableExpr* expr) {
+  value = scope->get(expr->name->lexeme);
 }
 
-void Interpreter::visit(BlockStmt* stmt) {
-  for (auto& stmt : stmt->statements) stmt->accept(*this);
+void Interpreter::visit(const BlockStmt* stmt) {
+  for (auto& stmt : stmt->statements) execute(stmt.get());
   value = nullptr;
 }
 
-void Interpreter::visit(ClassStmt* stmt) {}
+void Interpreter::visit(const ClassStmt* stmt) {}
 
-void Interpreter::visit(ExpressionStmt* stmt) {
+void Interpreter::visit(const ExpressionStmt* stmt) {
   value = evaluate(stmt->expression.get());
 }
 
-void Interpreter::visit(FunctionStmt* stmt) {}
+void Interpreter::visit(const FunctionStmt* stmt) {
+  scope->define(stmt->name->lexeme, heap.allocate<Function>(stmt));
+}
 
-void Interpreter::visit(IfStmt* stmt) {
+void Interpreter::visit(const IfStmt* stmt) {
   value = evaluate(stmt->condition.get());
+  if (halted) {
+    value = nullptr;
+    return;
+  }
   if (value->isTrue())
     execute(stmt->thenBranch.get());
   else if (stmt->elseBranch)
@@ -192,26 +430,32 @@ void Interpreter::visit(IfStmt* stmt) {
   value = nullptr;
 }
 
-void Interpreter::visit(PrintStmt* stmt) {
+void Interpreter::visit(const PrintStmt* stmt) {
   value = evaluate(stmt->expression.get());
-  if (value) {
-    std::cout << value->toString() << std::endl;
-  }
+  if (value && !halted) print(value);
   value = nullptr;
 }
 
-void Interpreter::visit(ReturnStmt* stmt) {}
+void Interpreter::visit(const ReturnStmt* stmt) {
+  returnValue = stmt->value ? evaluate(stmt->value.get()) : heap.nil();
+  returning = true;
+}
 
-void Interpreter::visit(VarStmt* stmt) {
-  if (stmt->initializer) value = evaluate(stmt->initializer.get());
-  environment->define(stmt->name->lexeme, value->clone());
+void Interpreter::visit(const VarStmt* stmt) {
+  if (stmt->initializer)
+    value = evaluate(stmt->initializer.get());
+  else
+    value = heap.nil();
+  scope->define(stmt->name->lexeme, value);
   value = nullptr;
 }
 
-void Interpreter::visit(WhileStmt* stmt) {
+void Interpreter::visit(const WhileStmt* stmt) {
   value = evaluate(stmt->condition.get());
-  while (value->isTrue()) {
+  while (!returning && !halted && value->isTrue()) {
     execute(stmt->body.get());
+    checkpoint();
+    if (returning || halted) break;
     value = evaluate(stmt->condition.get());
   }
   value = nullptr;
@@ -0,0 +1,119 @@
+#include "lox/memory-stats.h"
+
+#include <sys/resource.h>
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace llox;
+
+std::atomic<bool> MemoryStats::counting{false};
+
+namespace {
+
+struct Counters {
+  std::atomic<std::size_t> allocations{0};
+  std::atomic<std::size_t> frees{0};
+  std::atomic<std::size_t> bytesAllocated{0};
+  std::atomic<std::size_t> bytesFreed{0};
+  std::atomic<std::size_t> peakBytes{0};
+  std::atomic<std::size_t> liveBytes{0};
+};
+
+Counters counters[kNumMemoryCategories];
+
+std::atomic<std::size_t> totalLiveBytes{0};
+std::atomic<std::size_t> totalPeakBytes{0};
+
+thread_local std::size_t allocationsOnThread = 0;
+
+const char* const kCategoryNames[kNumMemoryCategories] = {
+    "tokens", "syntax tree nodes", "values", "strings", "environments",
+};
+
+void raise(std::atomic<std::size_t>& peak, std::size_t value) {
+  std::size_t current = peak.load(std::memory_order_relaxed);
+  while (value > current &&
+         !peak.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    ;
+}
+
+/// Subtracts `bytes` from `live` without going below zero, since objects
+/// created before counting started are not part of it.
+void lower(std::atomic<std::size_t>& live, std::size_t bytes) {
+  std::size_t current = live.load(std::memory_order_relaxed);
+  while (!live.compare_exchange_weak(current,
+                                     current > bytes ? current - bytes : 0,
+                                     std::memory_order_relaxed))
+    ;
+}
+
+}  // namespace
+
+void MemoryStats::enable() { counting = true; }
+
+void MemoryStats::recordAllocation(MemoryCategory category,
+                                   std::size_t bytes) {
+  Counters& counter = counters[category];
+  counter.allocations.fetch_add(1, std::memory_order_relaxed);
+  counter.bytesAllocated.fetch_add(bytes, std::memory_order_relaxed);
+  raise(counter.peakBytes,
+        counter.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+  raise(totalPeakBytes,
+        totalLiveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+  allocationsOnThread += 1;
+}
+
+void MemoryStats::recordFree(MemoryCategory category, std::size_t bytes) {
+  Counters& counter = counters[category];
+  counter.frees.fetch_add(1, std::memory_order_relaxed);
+  counter.bytesFreed.fetch_add(bytes, std::memory_order_relaxed);
+  lower(counter.liveBytes, bytes);
+  lower(totalLiveBytes, bytes);
+}
+
+MemoryCategoryStats MemoryStats::get(MemoryCategory category) {
+  const Counters& counter = counters[category];
+  MemoryCategoryStats stats;
+  stats.allocations = counter.allocations.load(std::memory_order_relaxed);
+  stats.frees = counter.frees.load(std::memory_order_relaxed);
+  stats.bytesAllocated = counter.bytesAllocated.load(std::memory_order_relaxed);
+  stats.bytesFreed = counter.bytesFreed.load(std::memory_order_relaxed);
+  stats.liveBytes = counter.liveBytes.load(std::memory_order_relaxed);
+  stats.peakBytes = counter.peakBytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+std::size_t MemoryStats::peakBytes() {
+  return totalPeakBytes.load(std::memory_order_relaxed);
+}
+
+std::size_t MemoryStats::threadAllocations() { return allocationsOnThread; }
+
+void MemoryStats::countOperatorNew() { allocationsOnThread += 1; }
+
+void MemoryStats::printStats(std::ostream& out) {
+  for (std::size_t index = 0; index < kNumMemoryCategories; ++index) {
+    MemoryCategoryStats stats = get(static_cast<MemoryCategory>(index));
+    const char* name = kCategoryNames[index];
+    out << "mem: " << name << " allocated: " << stats.allocations << "\n"
+        << "mem: " << name << " freed: " << stats.frees << "\n"
+        << "mem: " << name << " bytes allocated: " << stats.bytesAllocated
+        << "\n"
+        << "mem: " << name << " live bytes: " << stats.liveBytes << "\n"
+        << "mem: " << name << " peak bytes: " << stats.peakBytes << "\n";
+  }
+  out << "mem: peak bytes: " << peakBytes() << "\n";
+
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    out << "mem: peak rss: " << usage.ru_maxrss << "kB\n";
+}
+
+void AllocationCheck::assertNone(const char* what) const {
+  std::size_t count = allocations();
+  if (count == 0) return;
+  std::cerr << "error: " << what << " allocated " << count
+            << " objects, expected none\n";
+  std::abort();
+}
@@ -0,0 +1,83 @@
+#include "lox/output.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+
+using namespace llox;
+
+namespace {
+
+std::mutex sinksLock;
+FileOutputSink* sinks = nullptr;
+
+}  // namespace
+
+FileOutputSink::FileOutputSink(int fd, std::size_t capacity)
+    : fd(fd),
+      lineBuffered(isatty(fd)),
+      buffer(new char[capacity]),
+      capacity(capacity) {
+  std::lock_guard<std::mutex> guard(sinksLock);
+  next = sinks;
+  if (next) next->previous = this;
+  sinks = this;
+}
+
+FileOutputSink::~FileOutputSink() {
+  flush();
+  std::lock_guard<std::mutex> guard(sinksLock);
+  if (previous)
+    previous->next = next;
+  else
+    sinks = next;
+  if (next) next->previous = previous;
+}
+
+void FileOutputSink::flushAll() {
+  std::lock_guard<std::mutex> guard(sinksLock);
+  for (FileOutputSink* sink = sinks; sink; sink = sink->next) sink->flush();
+}
+
+void FileOutputSink::write(const char* data, std::size_t size) {
+  if (used + size > capacity) {
+    flush();
+    // Anything that would not fit in an empty buffer skips it entirely.
+    if (size > capacity) {
+      writeAll(data, size);
+      return;
+    }
+  }
+
+  std::memcpy(buffer.get() + used, data, size);
+  used += size;
+
+  if (lineBuffered && std::memchr(data, '\n', size)) flush();
+}
+
+void FileOutputSink::flush() {
+  // Leaves an empty buffer untouched, so an unbuffered sink never modifies
+  // its own state.
+  if (used == 0) return;
+  writeAll(buffer.get(), used);
+  used = 0;
+}
+
+OutputSink& llox::standardError() {
+  static FileOutputSink* sink = new FileOutputSink(STDERR_FILENO, 0);
+  return *sink;
+}
+
+void FileOutputSink::writeAll(const char* data, std::size_t size) {
+  while (size > 0) {
+    ssize_t written = ::write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    data += written;
+    size -= written;
+  }
+}
@@ -1,8 +1,10 @@
 #include "lox/parser.h"
 
-#include <iostream>
+#include <cstdint>
+#include <cstring>
 #include <vector>
 
+#include "lox/trace.h"
 #include "lox/util.h"
 
 using namespace llox;
@@ -10,15 +12,87 @@ using namespace llox;
 std::unique_ptr<StmtList> Parser::parse() {
   std::unique_ptr<StmtList> statements(new StmtList());
 
+  while (std::unique_ptr<Stmt> stmt = next())
+    statements->push_back(std::move(stmt));
+
+  return statements;
+}
+
+std::unique_ptr<Stmt> Parser::next() {
+  parsedFunction = false;
   while (!isAtEnd()) {
+    // Tokens of earlier statements have been moved into the AST or are no
+    // longer needed. Only the last one is kept, for `previous()`.
+    if (scanner && current > 1) {
+      tokens->erase(tokens->begin(), tokens->begin() + current - 1);
+      current = 1;
+    }
+
     std::unique_ptr<Stmt> stmt = declaration();
-    if (stmt) statements->push_back(std::move(stmt));
+    if (stmt) return stmt;
+    synchronize();
   }
 
-  return statements;
+  return nullptr;
+}
+
+namespace {
+
+// Unparsed function bodies are kept as a sequence of tokens, each encoded as
+// its type, line and lexeme. Literal values are recomputed from the lexeme
+// as the scanner does.
+
+void encodeToken(const Token& token, std::string& code) {
+  std::uint32_t fields[] = {token.type, token.line,
+                            static_cast<std::uint32_t>(token.lexeme.size())};
+  code.append(reinterpret_cast<const char*>(fields), sizeof(fields));
+  code.append(token.lexeme);
+}
+
+std::unique_ptr<Scanner::TokenList> decodeTokens(const std::string& code) {
+  std::unique_ptr<Scanner::TokenList> tokens(new Scanner::TokenList());
+  std::uint32_t fields[3];
+  for (std::size_t offset = 0; offset < code.size();) {
+    std::memcpy(fields, code.data() + offset, sizeof(fields));
+    offset += sizeof(fields);
+    TokenType type = static_cast<TokenType>(fields[0]);
+    std::string lexeme = code.substr(offset, fields[2]);
+    offset += fields[2];
+
+    if (type == STRING)
+      tokens->push_back(llox::make_unique<StringToken>(
+          lexeme, fields[1], lexeme.substr(1, lexeme.size() - 2)));
+    else if (type == NUMBER)
+      tokens->push_back(llox::make_unique<NumberToken>(
+          lexeme, fields[1], Scanner::numberValue(lexeme)));
+    else
+      tokens->push_back(llox::make_unique<Token>(type, lexeme, fields[1]));
+  }
+  return tokens;
+}
+
+}  // namespace
+
+const StmtList* Parser::functionBody(const FunctionStmt& function) {
+  std::call_once(function.bodyParsed, [&function] {
+    if (function.bodyCode.empty()) return;
+
+    LLOX_TRACE_SPAN(span, "parse function");
+    std::unique_ptr<Scanner::TokenList> tokens =
+        decodeTokens(function.bodyCode);
+    std::string().swap(function.bodyCode);
+    StringOutputSink errors;
+    Parser parser(std::move(tokens), errors, DeferBodies);
+    std::unique_ptr<StmtList> statements = parser.parse();
+    function.body.swap(*statements);
+    function.bodyErrors = errors.str();
+    LLOX_TRACE_ARG(span, "statements", function.body.size());
+  });
+  return function.bodyErrors.empty() ? &function.body : nullptr;
 }
 
 std::unique_ptr<Stmt> Parser::declaration() {
+  if (match(FUN)) return function();
   if (match(VAR)) return varDeclaration();
 
   return statement();
@@ -37,12 +111,63 @@ std::unique_ptr<Stmt> Parser::varDeclaration() {
   return llox::make_stmt<VarStmt>(name, initializer);
 }
 
+// function -> IDENTIFIER "(" parameters? ")" "{" ... "}"
+//
+// The body is only skipped over here, by matching braces, and its tokens are
+// kept in the declaration to be parsed on the first call.
+std::unique_ptr<Stmt> Parser::function() {
+  if (!consume(IDENTIFIER, "Expect function name.")) return nullptr;
+  std::unique_ptr<Token> name = releaseLastToken();
+
+  if (!consume(LEFT_PAREN, "Expect '(' after function name.")) return nullptr;
+  std::vector<std::unique_ptr<Token>> parameters;
+  if (!check(RIGHT_PAREN)) {
+    do {
+      if (parameters.size() >= 8) {
+        error("Cannot have more than 8 parameters.");
+        return nullptr;
+      }
+      if (!consume(IDENTIFIER, "Expect parameter name.")) return nullptr;
+      parameters.push_back(releaseLastToken());
+    } while (match(COMMA));
+  }
+  if (!consume(RIGHT_PAREN, "Expect ')' after parameters.")) return nullptr;
+
+  if (!consume(LEFT_BRACE, "Expect '{' before function body.")) return nullptr;
+  parsedFunction = true;
+
+  std::size_t start = current;
+  std::string body;
+  unsigned int depth = 0;
+  while (!isAtEnd() && (depth > 0 || !check(RIGHT_BRACE))) {
+    if (check(LEFT_BRACE))
+      depth += 1;
+    else if (check(RIGHT_BRACE))
+      depth -= 1;
+    encodeToken(*advance(), body);
+  }
+  if (!consume(RIGHT_BRACE, "Expect '}' after block.")) return nullptr;
+  encodeToken(Token(END, "", previous()->line), body);
+
+  // Only building the statements waits for the first call. The syntax of
+  // the body is checked now, without building anything, so that its errors
+  // are reported with the rest and stop the program from running.
+  if (bodies == CheckBodies) checkBody(start);
+
+  return llox::make_unique<FunctionStmt>(std::move(name), parameters, body);
+}
+
 std::unique_ptr<Stmt> Parser::statement() {
   if (match(IF)) return ifStatement();
   if (match(FOR)) return forStatement();
   if (match(WHILE)) return whileStatement();
   if (match(PRINT)) return printStatement();
-  if (check(LEFT_BRACE)) return llox::make_unique<BlockStmt>(*block());
+  if (match(RETURN)) return returnStatement();
+  if (check(LEFT_BRACE)) {
+    std::unique_ptr<StmtList> statements = block();
+    if (!statements) return nullptr;
+    return llox::make_unique<BlockStmt>(*statements);
+  }
 
   return expressionStatement();
 }
@@ -122,6 +247,17 @@ std::unique_ptr<Stmt> Parser::printStatement() {
   return llox::make_stmt<PrintStmt>(value);
 }
 
+std::unique_ptr<Stmt> Parser::returnStatement() {
+  std::unique_ptr<Token> keyword = releaseLastToken();
+  std::unique_ptr<Expr> value = nullptr;
+  if (!check(SEMICOLON)) {
+    value = expression();
+    if (!value) return nullptr;
+  }
+  if (!consume(SEMICOLON, "Expect ';' after return value.")) return nullptr;
+  return llox::make_stmt<ReturnStmt>(keyword, value);
+}
+
 std::unique_ptr<Stmt> Parser::expressionStatement() {
   std::unique_ptr<Expr> expr = expression();
   if (!consume(SEMICOLON, "Expect ';' after expression.")) return nullptr;
@@ -132,8 +268,13 @@ std::unique_ptr<StmtList> Parser::block() {
   if (!consume(LEFT_BRACE, "Expect '{' before block.")) return nullptr;
   std::unique_ptr<StmtList> statements(new StmtList());
 
-  while (!check(RIGHT_BRACE) && !isAtEnd())
-    statements->push_back(declaration());
+  while (!check(RIGHT_BRACE) && !isAtEnd()) {
+    std::unique_ptr<Stmt> stmt = declaration();
+    if (stmt)
+      statements->push_back(std::move(stmt));
+    else
+      synchronize();
+  }
 
   if (!consume(RIGHT_BRACE, "Expect '}' after block.")) return nullptr;
 
@@ -171,6 +312,7 @@ bool Parser::match(TokenT... types) {
 // assignment -> or ( "=" assignment )?
 std::unique_ptr<Expr> Parser::assignment() {
   std::unique_ptr<Expr> expr = lor();
+  if (!expr) return nullptr;
 
   if (match(EQUAL)) {
     std::unique_ptr<Token> equals = releaseLastToken();
@@ -193,7 +335,7 @@ std::unique_ptr<Expr> Parser::assignment() {
       }
       default:
         // TODO: Create a proper error handling abstraction.
-        std::cerr << "error: Invalid assignment target.\n";
+        error("Invalid assignment target.");
         return nullptr;
         break;
     }
@@ -205,6 +347,7 @@ std::unique_ptr<Expr> Parser::assignment() {
 // or -> and ( "or" and )*
 std::unique_ptr<Expr> Parser::lor() {
   std::unique_ptr<Expr> expr = land();
+  if (!expr) return nullptr;
 
   while (match(OR)) {
     std::unique_ptr<Token> op = releaseLastToken();
@@ -219,6 +362,7 @@ std::unique_ptr<Expr> Parser::lor() {
 // and -> equality ( "and" equality )*
 std::unique_ptr<Expr> Parser::land() {
   std::unique_ptr<Expr> expr = equality();
+  if (!expr) return nullptr;
 
   while (match(AND)) {
     std::unique_ptr<Token> op = releaseLastToken();
@@ -293,7 +437,7 @@ std::unique_ptr<Expr> Parser::finishCallExpr(std::unique_ptr<Expr> callee) {
   if (!check(RIGHT_PAREN)) {
     do {
       if (arguments.size() >= 8) {
-        std::cerr << "error: Cannot have more than 8 arguments.\n";
+        error("Cannot have more than 8 arguments.");
         return nullptr;
       }
       std::unique_ptr<Expr> expr = expression();
@@ -312,10 +456,12 @@ std::unique_ptr<Expr> Parser::finishCallExpr(std::unique_ptr<Expr> callee) {
 
 std::unique_ptr<Expr> Parser::call() {
   std::unique_ptr<Expr> expr = primary();
+  if (!expr) return nullptr;
 
   while (true) {
     if (match(LEFT_PAREN)) {
       expr = finishCallExpr(std::move(expr));
+      if (!expr) return nullptr;
     } else if (match(DOT)) {
       if (consume(IDENTIFIER, "Expect property name after '.'."))
         expr = llox::make_expr<GetExpr>(expr, releaseLastToken());
@@ -373,11 +519,237 @@ std::unique_ptr<Expr> Parser::primary() {
     return llox::make_expr<GroupingExpr>(expr);
   }
 
-  std::cerr << "Expect expression.\n";
+  failed = true;
+  errors.write("Expect expression.\n");
 
   return nullptr;
 }
 
+// The syntax of a function body is checked by walking its tokens a second
+// time with the methods below. Each follows the parsing method of the same
+// name and reports the same errors, but only says whether that method would
+// have returned a node. Functions declared in the body are checked as part
+// of it.
+
+void Parser::checkBody(std::size_t start) {
+  std::size_t resume = current;
+  current = start;
+  // The closing brace.
+  end = resume - 1;
+  while (!isAtEnd())
+    if (!checkDeclaration()) synchronize();
+  end = kNoEnd;
+  current = resume;
+}
+
+bool Parser::checkDeclaration() {
+  if (match(FUN)) return checkFunction();
+  if (match(VAR)) return checkVarDeclaration();
+
+  return checkStatement();
+}
+
+bool Parser::checkVarDeclaration() {
+  if (!consume(IDENTIFIER, "Expect variable name.")) return false;
+  if (match(EQUAL)) checkExpression();
+  return consume(SEMICOLON, "Expect ';' after variable declaration.");
+}
+
+bool Parser::checkFunction() {
+  if (!consume(IDENTIFIER, "Expect function name.")) return false;
+  if (!consume(LEFT_PAREN, "Expect '(' after function name.")) return false;
+  if (!check(RIGHT_PAREN)) {
+    std::size_t parameters = 0;
+    do {
+      if (parameters >= 8) {
+        error("Cannot have more than 8 parameters.");
+        return false;
+      }
+      if (!consume(IDENTIFIER, "Expect parameter name.")) return false;
+      parameters += 1;
+    } while (match(COMMA));
+  }
+  if (!consume(RIGHT_PAREN, "Expect ')' after parameters.")) return false;
+  if (!consume(LEFT_BRACE, "Expect '{' before function body.")) return false;
+  return checkBlockBody();
+}
+
+bool Parser::checkStatement() {
+  if (match(IF)) return checkIfStatement();
+  if (match(FOR)) return checkForStatement();
+  if (match(WHILE)) return checkWhileStatement();
+  if (match(PRINT)) {
+    checkExpression();
+    return consume(SEMICOLON, "Expect ';' after value.");
+  }
+  if (match(RETURN)) {
+    if (!check(SEMICOLON) && !checkExpression()) return false;
+    return consume(SEMICOLON, "Expect ';' after return value.");
+  }
+  if (check(LEFT_BRACE)) {
+    if (!consume(LEFT_BRACE, "Expect '{' before block.")) return false;
+    return checkBlockBody();
+  }
+
+  checkExpression();
+  return consume(SEMICOLON, "Expect ';' after expression.");
+}
+
+bool Parser::checkIfStatement() {
+  if (!consume(LEFT_PAREN, "Expect '(' after 'if'.")) return false;
+  checkExpression();
+  if (!consume(RIGHT_PAREN, "Expect ')' after if condition.")) return false;
+  checkStatement();
+  if (match(ELSE)) checkStatement();
+  return true;
+}
+
+bool Parser::checkForStatement() {
+  if (!consume(LEFT_PAREN, "Expect '(' after 'for'.")) return false;
+
+  if (match(VAR)) {
+    checkVarDeclaration();
+  } else if (!match(SEMICOLON)) {
+    checkExpression();
+    consume(SEMICOLON, "Expect ';' after expression.");
+  }
+
+  if (!check(SEMICOLON)) checkExpression();
+  if (!consume(SEMICOLON, "Expect ';' after loop condition.")) return false;
+
+  if (!check(RIGHT_PAREN)) checkExpression();
+  if (!consume(RIGHT_PAREN, "Expect ')' after for clauses.")) return false;
+
+  checkStatement();
+  return true;
+}
+
+bool Parser::checkWhileStatement() {
+  if (!consume(LEFT_PAREN, "Expect '(' after 'while'.")) return false;
+  checkExpression();
+  if (!consume(RIGHT_PAREN, "Expect ')' after if condition.")) return false;
+  checkStatement();
+  return true;
+}
+
+bool Parser::checkBlockBody() {
+  while (!check(RIGHT_BRACE) && !isAtEnd())
+    if (!checkDeclaration()) synchronize();
+  return consume(RIGHT_BRACE, "Expect '}' after block.");
+}
+
+// Besides whether there is an expression, assignment needs to know if it is
+// a variable or a property, which `assignable` tells.
+bool Parser::checkExpression() {
+  if (!checkBinary(0)) return false;
+
+  if (match(EQUAL)) {
+    bool target = assignable;
+    if (!checkExpression()) return false;
+    if (!target) {
+      error("Invalid assignment target.");
+      return false;
+    }
+    assignable = false;
+  }
+
+  return true;
+}
+
+// Levels 0 to 5 are `or`, `and`, equality, comparison, terms and factors,
+// whose operands are the next level up. Those of factors are unary.
+bool Parser::checkBinary(int level) {
+  if (level > 5) return checkUnary();
+  if (!checkBinary(level + 1)) return false;
+  while (matchOperator(level)) {
+    if (!checkBinary(level + 1)) return false;
+    assignable = false;
+  }
+  return true;
+}
+
+bool Parser::matchOperator(int level) {
+  switch (level) {
+    case 0:
+      return match(OR);
+    case 1:
+      return match(AND);
+    case 2:
+      return match(BANG_EQUAL, EQUAL_EQUAL);
+    case 3:
+      return match(GREATER, GREATER_EQUAL, LESS, LESS_EQUAL);
+    case 4:
+      return match(MINUS, PLUS);
+    default:
+      return match(SLASH, STAR, PERCENT);
+  }
+}
+
+bool Parser::checkUnary() {
+  if (match(MINUS, BANG)) {
+    if (!checkExpression()) return false;
+    assignable = false;
+    return true;
+  }
+
+  return checkCall();
+}
+
+bool Parser::checkCall() {
+  if (!checkPrimary()) return false;
+
+  while (true) {
+    if (match(LEFT_PAREN)) {
+      if (!check(RIGHT_PAREN)) {
+        std::size_t arguments = 0;
+        do {
+          if (arguments >= 8) {
+            error("Cannot have more than 8 arguments.");
+            return false;
+          }
+          if (!checkExpression()) return false;
+          arguments += 1;
+        } while (match(COMMA));
+      }
+      if (!consume(RIGHT_PAREN, "Expect ')' after arguments.")) return false;
+      assignable = false;
+    } else if (match(DOT)) {
+      if (consume(IDENTIFIER, "Expect property name after '.'."))
+        assignable = true;
+    } else {
+      break;
+    }
+  }
+
+  return true;
+}
+
+bool Parser::checkPrimary() {
+  assignable = false;
+  if (match(NUMBER, STRING, FALSE, TRUE, NIL, THIS)) return true;
+
+  if (match(SUPER)) {
+    if (!consume(DOT, "Expect '.' after 'super'.")) return false;
+    return consume(IDENTIFIER, "Expect superclass method name.");
+  }
+
+  if (match(IDENTIFIER)) {
+    assignable = true;
+    return true;
+  }
+
+  if (match(LEFT_PAREN)) {
+    if (!checkExpression()) return false;
+    assignable = false;
+    return consume(RIGHT_PAREN, "Expect ')' after expression.");
+  }
+
+  failed = true;
+  errors.write("Expect expression.\n");
+
+  return false;
+}
+
 bool Parser::consume(TokenType type, const std::string& message) {
   if (check(type)) {
     advance();
@@ -385,6 +757,32 @@ bool Parser::consume(TokenType type, const std::string& message) {
   }
 
   // TODO: Create a proper error handling abstraction.
-  std::cerr << "error: " << message << "\n";
+  error(message);
   return false;
 }
+
+// Skips tokens until the start of the next statement, so that one syntax
+// error does not cascade into many.
+void Parser::synchronize() {
+  if (!isAtEnd()) advance();
+
+  while (!isAtEnd()) {
+    if (previous()->type == SEMICOLON) return;
+
+    switch (peek()->type) {
+      case CLASS:
+      case FUN:
+      case VAR:
+      case FOR:
+      case IF:
+      case WHILE:
+      case PRINT:
+      case RETURN:
+        return;
+      default:
+        break;
+    }
+
+    advance();
+  }
+}
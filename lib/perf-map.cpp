@@ -0,0 +1,123 @@
+#include "lox/perf-map.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+using namespace llox;
+
+bool PerfMap::opened = false;
+
+namespace {
+
+// Both trampolines push a frame record, call the entry point passed as the
+// third argument with the first two arguments unchanged, and return.
+#if defined(__x86_64__)
+const unsigned char kTrampolineCode[] = {
+    0x55,              // push %rbp
+    0x48, 0x89, 0xe5,  // mov %rsp, %rbp
+    0xff, 0xd2,        // call *%rdx
+    0x5d,              // pop %rbp
+    0xc3,              // ret
+};
+#elif defined(__aarch64__)
+const std::uint32_t kTrampolineCode[] = {
+    0xa9bf7bfd,  // stp x29, x30, [sp, #-16]!
+    0x910003fd,  // mov x29, sp
+    0xd63f0040,  // blr x2
+    0xa8c17bfd,  // ldp x29, x30, [sp], #16
+    0xd65f03c0,  // ret
+};
+#endif
+
+/// Trampolines are spaced this far apart, so that each starts aligned and
+/// has a symbol of its own.
+constexpr std::size_t kTrampolineSize = 32;
+
+/// Trampolines are made this many bytes at a time, all copies of the same
+/// code, and handed out one by one.
+constexpr std::size_t kArenaSize = 64 * 1024;
+
+std::mutex lock;
+int mapFile = -1;
+char* arena = nullptr;
+std::size_t arenaUsed = kArenaSize;
+
+/// Maps a new arena of trampolines. Returns false if out of memory.
+bool grow() {
+#if defined(__x86_64__) || defined(__aarch64__)
+  void* memory = mmap(nullptr, kArenaSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) return false;
+
+  char* code = static_cast<char*>(memory);
+  for (std::size_t offset = 0; offset < kArenaSize; offset += kTrampolineSize)
+    std::memcpy(code + offset, kTrampolineCode, sizeof(kTrampolineCode));
+  if (mprotect(memory, kArenaSize, PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, kArenaSize);
+    return false;
+  }
+  __builtin___clear_cache(code, code + kArenaSize);
+
+  arena = code;
+  arenaUsed = 0;
+  return true;
+#else
+  return false;
+#endif
+}
+
+}  // namespace
+
+bool PerfMap::open() {
+  std::lock_guard<std::mutex> guard(lock);
+  if (opened) return true;
+  if (!grow()) return false;
+
+  std::string path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+  mapFile = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND |
+                                     O_CLOEXEC,
+                   0644);
+  if (mapFile < 0) return false;
+  opened = true;
+  return true;
+}
+
+PerfMap::Trampoline PerfMap::trampolineFor(const FunctionStmt& function) {
+  void* trampoline = function.perfTrampoline.load(std::memory_order_acquire);
+  if (trampoline || !opened) return reinterpret_cast<Trampoline>(trampoline);
+
+  std::lock_guard<std::mutex> guard(lock);
+  trampoline = function.perfTrampoline.load(std::memory_order_relaxed);
+  if (trampoline) return reinterpret_cast<Trampoline>(trampoline);
+  if (arenaUsed == kArenaSize && !grow()) return nullptr;
+
+  char* code = arena + arenaUsed;
+  arenaUsed += kTrampolineSize;
+
+  // Written in one call, so that the map never holds part of a line even if
+  // the process ends abruptly.
+  char line[256];
+  int length = std::snprintf(
+      line, sizeof(line), "%zx %zx lox:%s:%u\n",
+      static_cast<std::size_t>(reinterpret_cast<std::uintptr_t>(code)),
+      sizeof(kTrampolineCode),
+      function.name->lexeme.c_str(), function.name->line);
+  if (length > 0) {
+    std::size_t size = std::min<std::size_t>(length, sizeof(line) - 1);
+    if (size == sizeof(line) - 1) line[size - 1] = '\n';
+    if (write(mapFile, line, size) < 0) {
+      // A function left out of the map only goes unnamed in profiles.
+    }
+  }
+
+  function.perfTrampoline.store(code, std::memory_order_release);
+  return reinterpret_cast<Trampoline>(code);
+}
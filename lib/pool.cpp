@@ -0,0 +1,146 @@
+#include "lox/pool.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+using namespace llox;
+
+namespace {
+
+struct FreeBlock {
+  FreeBlock* next;
+};
+
+struct FreeList {
+  FreeBlock* head = nullptr;
+  std::size_t count = 0;
+
+  void push(FreeBlock* block) {
+    block->next = head;
+    head = block;
+    count += 1;
+  }
+
+  FreeBlock* pop() {
+    FreeBlock* block = head;
+    head = block->next;
+    count -= 1;
+    return block;
+  }
+};
+
+std::atomic<std::size_t> refills{0};
+std::atomic<std::size_t> mallocCalls{0};
+std::atomic<std::size_t> mallocBytes{0};
+
+void* globalAllocate(std::size_t size) {
+  mallocCalls.fetch_add(1, std::memory_order_relaxed);
+  mallocBytes.fetch_add(size, std::memory_order_relaxed);
+  void* memory = std::malloc(size);
+  if (!memory) throw std::bad_alloc();
+  return memory;
+}
+
+/// Free lists shared by all threads, guarded by a single lock. Only touched
+/// when a thread cache runs dry or overflows.
+class Central {
+  std::mutex lock;
+  FreeList lists[ObjectPool::kNumSizeClasses];
+
+ public:
+  /// Moves up to `kBatchSize` blocks of class `index` into `cache`.
+  void refill(std::size_t index, FreeList& cache) {
+    refills.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> guard(lock);
+    FreeList& list = lists[index];
+    if (!list.head) carve(index, list);
+    while (list.head && cache.count < ObjectPool::kBatchSize)
+      cache.push(list.pop());
+  }
+
+  /// Returns up to `count` blocks of class `index` from `cache`.
+  void release(std::size_t index, FreeList& cache, std::size_t count) {
+    std::lock_guard<std::mutex> guard(lock);
+    FreeList& list = lists[index];
+    while (cache.head && count-- > 0) list.push(cache.pop());
+  }
+
+ private:
+  static void carve(std::size_t index, FreeList& list) {
+    std::size_t blockSize = (index + 1) * ObjectPool::kGranularity;
+    char* slab = static_cast<char*>(globalAllocate(ObjectPool::kSlabSize));
+    for (std::size_t offset = 0; offset + blockSize <= ObjectPool::kSlabSize;
+         offset += blockSize)
+      list.push(reinterpret_cast<FreeBlock*>(slab + offset));
+  }
+};
+
+Central& central() {
+  // Deliberately leaked so that thread caches can still flush into it while
+  // static destructors run.
+  static Central* instance = new Central();
+  return *instance;
+}
+
+struct ThreadCache {
+  FreeList lists[ObjectPool::kNumSizeClasses];
+  std::size_t cachedAllocations = 0;
+
+  ~ThreadCache() {
+    for (std::size_t index = 0; index < ObjectPool::kNumSizeClasses; ++index)
+      central().release(index, lists[index], lists[index].count);
+  }
+};
+
+thread_local ThreadCache cache;
+
+std::size_t sizeClass(std::size_t size) {
+  return (size + ObjectPool::kGranularity - 1) / ObjectPool::kGranularity - 1;
+}
+
+}  // namespace
+
+void* ObjectPool::allocate(std::size_t size) {
+  if (size == 0 || size > kMaxSize) return globalAllocate(size);
+
+  std::size_t index = sizeClass(size);
+  FreeList& list = cache.lists[index];
+  if (list.head)
+    cache.cachedAllocations += 1;
+  else
+    central().refill(index, list);
+  return list.pop();
+}
+
+void ObjectPool::deallocate(void* pointer, std::size_t size) {
+  if (!pointer) return;
+  if (size == 0 || size > kMaxSize) {
+    std::free(pointer);
+    return;
+  }
+
+  std::size_t index = sizeClass(size);
+  FreeList& list = cache.lists[index];
+  list.push(static_cast<FreeBlock*>(pointer));
+  if (list.count > 2 * kBatchSize) central().release(index, list, kBatchSize);
+}
+
+PoolStats ObjectPool::stats() {
+  PoolStats result;
+  result.cachedAllocations = cache.cachedAllocations;
+  result.refills = refills.load(std::memory_order_relaxed);
+  result.mallocCalls = mallocCalls.load(std::memory_order_relaxed);
+  result.mallocBytes = mallocBytes.load(std::memory_order_relaxed);
+  return result;
+}
+
+void ObjectPool::printStats(std::ostream& out) {
+  PoolStats current = stats();
+  out << "pool: cached allocations: " << current.cachedAllocations << "\n"
+      << "pool: cache refills: " << current.refills << "\n"
+      << "pool: malloc calls: " << current.mallocCalls << "\n"
+      << "pool: malloc bytes: " << current.mallocBytes << "\n";
+}
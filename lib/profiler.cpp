@@ -0,0 +1,223 @@
+#include "lox/profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+using namespace llox;
+
+namespace {
+
+/// How many lines the hot-line report lists.
+constexpr std::size_t kHotLines = 20;
+
+/// The line of the first token found in `expr`, or 0 if it has none.
+unsigned int lineOf(const Expr* expr) {
+  switch (expr->kind) {
+    case Expr::AssignExprKind:
+      return static_cast<const AssignExpr*>(expr)->name->line;
+    case Expr::BinaryExprKind:
+      return static_cast<const BinaryExpr*>(expr)->op->line;
+    case Expr::CallExprKind:
+      return static_cast<const CallExpr*>(expr)->paren->line;
+    case Expr::GetExprKind:
+      return static_cast<const GetExpr*>(expr)->name->line;
+    case Expr::GroupingExprKind:
+      return lineOf(static_cast<const GroupingExpr*>(expr)->expression.get());
+    case Expr::LogicalExprKind:
+      return static_cast<const LogicalExpr*>(expr)->op->line;
+    case Expr::SetExprKind:
+      return static_cast<const SetExpr*>(expr)->name->line;
+    case Expr::SuperExprKind:
+      return static_cast<const SuperExpr*>(expr)->keyword->line;
+    case Expr::ThisExprKind:
+      return static_cast<const ThisExpr*>(expr)->keyword->line;
+    case Expr::UnaryExprKind:
+      return static_cast<const UnaryExpr*>(expr)->op->line;
+    case Expr::VariableExprKind:
+      return static_cast<const VariableExpr*>(expr)->name->line;
+    default:
+      return 0;
+  }
+}
+
+std::string formatMilliseconds(std::chrono::steady_clock::duration time) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%10.2f",
+                std::chrono::duration<double, std::milli>(time).count());
+  return text;
+}
+
+}  // namespace
+
+template <typename Node>
+void ProfilingInterpreter::profile(const Node* node, unsigned int nodeLine) {
+  if (nodeLine == 0) nodeLine = line;
+  if (nodeLine >= lines.size()) lines.resize(nodeLine + 1);
+  lines[nodeLine].hits += 1;
+
+  // A node on the line that is already running is part of its time.
+  if (nodeLine == line) {
+    Interpreter::visit(node);
+    return;
+  }
+
+  unsigned int outer = line;
+  line = nodeLine;
+  bool entered = lines[nodeLine].active++ == 0;
+  auto start = std::chrono::steady_clock::now();
+  Interpreter::visit(node);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  if (entered) lines[nodeLine].time += elapsed;
+  if (outer == 0) total += elapsed;
+  lines[nodeLine].active -= 1;
+  line = outer;
+}
+
+void ProfilingInterpreter::report(std::string_view source,
+                                  OutputSink& out) const {
+  std::vector<std::string_view> text;
+  while (!source.empty()) {
+    std::size_t end = std::min(source.find('\n'), source.size());
+    text.push_back(source.substr(0, end));
+    source.remove_prefix(std::min(end + 1, source.size()));
+  }
+  auto lineText = [&text](std::size_t number) {
+    return number - 1 < text.size() ? text[number - 1] : std::string_view();
+  };
+
+  std::vector<std::size_t> hot;
+  for (std::size_t number = 1; number < lines.size(); ++number)
+    if (lines[number].hits) hot.push_back(number);
+  std::sort(hot.begin(), hot.end(), [this](std::size_t a, std::size_t b) {
+    if (lines[a].time != lines[b].time) return lines[a].time > lines[b].time;
+    return lines[a].hits > lines[b].hits;
+  });
+  if (hot.size() > kHotLines) hot.resize(kHotLines);
+
+  double totalTime = std::chrono::duration<double>(total).count();
+  char header[64];
+  std::snprintf(header, sizeof(header), "profile: total %.2f ms\n",
+                totalTime * 1000);
+  out.write(header);
+  out.write("profile: hot lines\n");
+  out.write("  line         hits    time ms  time %  source\n");
+  for (std::size_t number : hot) {
+    const Line& stats = lines[number];
+    double share = totalTime > 0
+                       ? std::chrono::duration<double>(stats.time).count() /
+                             totalTime * 100
+                       : 0;
+    char prefix[64];
+    std::snprintf(prefix, sizeof(prefix), "%6zu %12llu %s %6.1f%%  ",
+                  number, static_cast<unsigned long long>(stats.hits),
+                  formatMilliseconds(stats.time).c_str(), share);
+    out.write(prefix + std::string(lineText(number)) + "\n");
+  }
+
+  out.write("profile: annotated source\n");
+  for (std::size_t number = 1; number <= text.size(); ++number) {
+    char prefix[64];
+    if (number < lines.size() && lines[number].hits)
+      std::snprintf(prefix, sizeof(prefix), "%s %12llu | ",
+                    formatMilliseconds(lines[number].time).c_str(),
+                    static_cast<unsigned long long>(lines[number].hits));
+    else
+      std::snprintf(prefix, sizeof(prefix), "%10s %12s | ", "", "");
+    out.write(prefix + std::string(text[number - 1]) + "\n");
+  }
+}
+
+void ProfilingInterpreter::visit(const AssignExpr* expr) {
+  profile(expr, expr->name->line);
+}
+
+void ProfilingInterpreter::visit(const BinaryExpr* expr) {
+  profile(expr, expr->op->line);
+}
+
+void ProfilingInterpreter::visit(const CallExpr* expr) {
+  profile(expr, expr->paren->line);
+}
+
+void ProfilingInterpreter::visit(const GetExpr* expr) {
+  profile(expr, expr->name->line);
+}
+
+void ProfilingInterpreter::visit(const GroupingExpr* expr) {
+  profile(expr, lineOf(expr));
+}
+
+void ProfilingInterpreter::visit(const BoolLiteralExpr* expr) {
+  profile(expr, 0);
+}
+
+void ProfilingInterpreter::visit(const NilLiteralExpr* expr) {
+  profile(expr, 0);
+}
+
+void ProfilingInterpreter::visit(const NumberLiteralExpr* expr) {
+  profile(expr, 0);
+}
+
+void ProfilingInterpreter::visit(const StringLiteralExpr* expr) {
+  profile(expr, 0);
+}
+
+void ProfilingInterpreter::visit(const LogicalExpr* expr) {
+  profile(expr, expr->op->line);
+}
+
+void ProfilingInterpreter::visit(const SetExpr* expr) {
+  profile(expr, expr->name->line);
+}
+
+void ProfilingInterpreter::visit(const SuperExpr* expr) {
+  profile(expr, expr->keyword->line);
+}
+
+void ProfilingInterpreter::visit(const ThisExpr* expr) {
+  profile(expr, expr->keyword->line);
+}
+
+void ProfilingInterpreter::visit(const UnaryExpr* expr) {
+  profile(expr, expr->op->line);
+}
+
+void ProfilingInterpreter::visit(const VariableExpr* expr) {
+  profile(expr, expr->name->line);
+}
+
+void ProfilingInterpreter::visit(const BlockStmt* stmt) { profile(stmt, 0); }
+
+void ProfilingInterpreter::visit(const ClassStmt* stmt) {
+  profile(stmt, stmt->name->line);
+}
+
+void ProfilingInterpreter::visit(const ExpressionStmt* stmt) {
+  profile(stmt, lineOf(stmt->expression.get()));
+}
+
+void ProfilingInterpreter::visit(const FunctionStmt* stmt) {
+  profile(stmt, stmt->name->line);
+}
+
+void ProfilingInterpreter::visit(const IfStmt* stmt) {
+  profile(stmt, lineOf(stmt->condition.get()));
+}
+
+void ProfilingInterpreter::visit(const PrintStmt* stmt) {
+  profile(stmt, lineOf(stmt->expression.get()));
+}
+
+void ProfilingInterpreter::visit(const ReturnStmt* stmt) {
+  profile(stmt, stmt->keyword->line);
+}
+
+void ProfilingInterpreter::visit(const VarStmt* stmt) {
+  profile(stmt, stmt->name->line);
+}
+
+void ProfilingInterpreter::visit(const WhileStmt* stmt) {
+  profile(stmt, lineOf(stmt->condition.get()));
+}
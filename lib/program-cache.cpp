@@ -0,0 +1,542 @@
+#include "lox/program-cache.h"
+
+#include <link.h>
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+#include "lox/ast.h"
+#include "lox/binary-file.h"
+#include "lox/parser.h"
+#include "lox/source-buffer.h"
+#include "lox/trace.h"
+
+using namespace llox;
+
+namespace {
+
+const char kMagic[4] = {'L', 'O', 'X', 'C'};
+
+struct Header {
+  char magic[4];
+  std::uint32_t version;
+  std::uint64_t sourceHash;
+  std::uint64_t buildIdentity;
+  std::uint32_t byteOrder;
+  std::uint32_t statementCount;
+  std::uint64_t nodesSize;
+  std::uint64_t stringsSize;
+};
+
+// Node tags. Children that may be absent are encoded as `NullTag`.
+enum Tag : std::uint8_t {
+  NullTag,
+  AssignTag,
+  BinaryTag,
+  CallTag,
+  GetTag,
+  GroupingTag,
+  BoolLiteralTag,
+  NilLiteralTag,
+  NumberLiteralTag,
+  StringLiteralTag,
+  LogicalTag,
+  SetTag,
+  SuperTag,
+  ThisTag,
+  UnaryTag,
+  VariableTag,
+  BlockTag,
+  ClassTag,
+  ExpressionTag,
+  FunctionTag,
+  IfTag,
+  PrintTag,
+  ReturnTag,
+  VarTag,
+  WhileTag,
+};
+
+/// Writes nodes to `data`.
+class Writer : public ExprVisitor, public StmtVisitor, public BinaryWriter {
+ public:
+  bool complete = true;
+
+  void stmt(const Stmt* stmt) {
+    if (stmt)
+      stmt->accept(*this);
+    else
+      u8(NullTag);
+  }
+
+  void statements(const StmtList& list) {
+    u32(list.size());
+    for (auto& stmt : list) this->stmt(stmt.get());
+  }
+
+  void expr(const Expr* expr) {
+    if (expr)
+      expr->accept(*this);
+    else
+      u8(NullTag);
+  }
+
+  void visit(const AssignExpr* expr) override {
+    u8(AssignTag);
+    token(expr->name.get());
+    this->expr(expr->value.get());
+  }
+
+  void visit(const BinaryExpr* expr) override {
+    u8(BinaryTag);
+    this->expr(expr->left.get());
+    token(expr->op.get());
+    this->expr(expr->right.get());
+  }
+
+  void visit(const CallExpr* expr) override {
+    u8(CallTag);
+    this->expr(expr->callee.get());
+    token(expr->paren.get());
+    u32(expr->arguments.size());
+    for (auto& argument : expr->arguments) this->expr(argument.get());
+  }
+
+  void visit(const GetExpr* expr) override {
+    u8(GetTag);
+    this->expr(expr->object.get());
+    token(expr->name.get());
+  }
+
+  void visit(const GroupingExpr* expr) override {
+    u8(GroupingTag);
+    this->expr(expr->expression.get());
+  }
+
+  void visit(const BoolLiteralExpr* expr) override {
+    u8(BoolLiteralTag);
+    u8(expr->value);
+  }
+
+  void visit(const NilLiteralExpr* expr) override { u8(NilLiteralTag); }
+
+  void visit(const NumberLiteralExpr* expr) override {
+    u8(NumberLiteralTag);
+    raw(&expr->value, sizeof(expr->value));
+  }
+
+  void visit(const StringLiteralExpr* expr) override {
+    u8(StringLiteralTag);
+    string(expr->value);
+  }
+
+  void visit(const LogicalExpr* expr) override {
+    u8(LogicalTag);
+    this->expr(expr->left.get());
+    token(expr->op.get());
+    this->expr(expr->right.get());
+  }
+
+  void visit(const SetExpr* expr) override {
+    u8(SetTag);
+    this->expr(expr->object.get());
+    token(expr->name.get());
+    this->expr(expr->value.get());
+  }
+
+  void visit(const SuperExpr* expr) override {
+    u8(SuperTag);
+    token(expr->keyword.get());
+    token(expr->method.get());
+  }
+
+  void visit(const ThisExpr* expr) override {
+    u8(ThisTag);
+    token(expr->keyword.get());
+  }
+
+  void visit(const UnaryExpr* expr) override {
+    u8(UnaryTag);
+    token(expr->op.get());
+    this->expr(expr->right.get());
+  }
+
+  void visit(const VariableExpr* expr) override {
+    u8(VariableTag);
+    token(expr->name.get());
+  }
+
+  void visit(const BlockStmt* stmt) override {
+    u8(BlockTag);
+    statements(stmt->statements);
+  }
+
+  void visit(const ClassStmt* stmt) override {
+    u8(ClassTag);
+    token(stmt->name.get());
+    expr(stmt->superclass.get());
+    statements(stmt->methods);
+  }
+
+  void visit(const ExpressionStmt* stmt) override {
+    u8(ExpressionTag);
+    expr(stmt->expression.get());
+  }
+
+  void visit(const FunctionStmt* stmt) override {
+    u8(FunctionTag);
+    token(stmt->name.get());
+    u32(stmt->parameters.size());
+    for (auto& parameter : stmt->parameters) token(parameter.get());
+
+    // Bodies are stored parsed, so a body with errors cannot be stored.
+    const StmtList* body = Parser::functionBody(*stmt);
+    if (body) {
+      statements(*body);
+    } else {
+      complete = false;
+      u32(0);
+    }
+  }
+
+  void visit(const IfStmt* stmt) override {
+    u8(IfTag);
+    expr(stmt->condition.get());
+    this->stmt(stmt->thenBranch.get());
+    this->stmt(stmt->elseBranch.get());
+  }
+
+  void visit(const PrintStmt* stmt) override {
+    u8(PrintTag);
+    expr(stmt->expression.get());
+  }
+
+  void visit(const ReturnStmt* stmt) override {
+    u8(ReturnTag);
+    token(stmt->keyword.get());
+    expr(stmt->value.get());
+  }
+
+  void visit(const VarStmt* stmt) override {
+    u8(VarTag);
+    token(stmt->name.get());
+    expr(stmt->initializer.get());
+  }
+
+  void visit(const WhileStmt* stmt) override {
+    u8(WhileTag);
+    expr(stmt->condition.get());
+    this->stmt(stmt->body.get());
+  }
+
+ private:
+  // Tokens kept in the AST are always plain tokens; literal tokens are
+  // folded into literal expressions by the parser.
+  void token(const Token* token) {
+    if (!token) {
+      u8(NullTag);
+      return;
+    }
+    u8(token->type + 1);
+    u32(token->line);
+    string(token->lexeme);
+  }
+};
+
+/// Rebuilds nodes from what a `Writer` wrote.
+class Reader : public BinaryReader {
+ public:
+  using BinaryReader::BinaryReader;
+
+  // The parser never leaves out a node or a token unless the grammar says it
+  // may, and the interpreter relies on that, so a file that does is
+  // rejected like any other malformed one.
+
+  bool statements(std::uint32_t count, StmtList& list) {
+    for (std::uint32_t index = 0; index < count && isValid(); ++index)
+      list.push_back(required(stmt()));
+    return isValid();
+  }
+
+  std::unique_ptr<Stmt> stmt() {
+    switch (u8()) {
+      case NullTag:
+        return nullptr;
+      case BlockTag: {
+        StmtList statements;
+        if (!this->statements(u32(), statements)) return nullptr;
+        return llox::make_unique<BlockStmt>(statements);
+      }
+      case ClassTag: {
+        std::unique_ptr<Token> name = token();
+        std::unique_ptr<Expr> superclass = expr();
+        StmtList methods;
+        if (!statements(u32(), methods)) return nullptr;
+        return llox::make_unique<ClassStmt>(std::move(name),
+                                            std::move(superclass), methods);
+      }
+      case ExpressionTag:
+        return llox::make_stmt<ExpressionStmt>(required(expr()));
+      case FunctionTag: {
+        std::unique_ptr<Token> name = token();
+        std::vector<std::unique_ptr<Token>> parameters;
+        std::uint32_t count = u32();
+        for (std::uint32_t index = 0; index < count && isValid(); ++index)
+          parameters.push_back(token());
+        StmtList body;
+        if (!statements(u32(), body)) return nullptr;
+        return llox::make_unique<FunctionStmt>(std::move(name), parameters,
+                                               body);
+      }
+      case IfTag: {
+        std::unique_ptr<Expr> condition = required(expr());
+        std::unique_ptr<Stmt> thenBranch = required(stmt());
+        std::unique_ptr<Stmt> elseBranch = stmt();
+        return llox::make_stmt<IfStmt>(condition, thenBranch, elseBranch);
+      }
+      case PrintTag:
+        return llox::make_stmt<PrintStmt>(required(expr()));
+      case ReturnTag: {
+        std::unique_ptr<Token> keyword = token();
+        return llox::make_stmt<ReturnStmt>(keyword, expr());
+      }
+      case VarTag: {
+        std::unique_ptr<Token> name = token();
+        return llox::make_stmt<VarStmt>(name, expr());
+      }
+      case WhileTag: {
+        std::unique_ptr<Expr> condition = required(expr());
+        return llox::make_stmt<WhileStmt>(condition, required(stmt()));
+      }
+      default:
+        fail();
+        return nullptr;
+    }
+  }
+
+  std::unique_ptr<Expr> expr() {
+    switch (u8()) {
+      case NullTag:
+        return nullptr;
+      case AssignTag: {
+        std::unique_ptr<Token> name = token();
+        return llox::make_expr<AssignExpr>(name, required(expr()));
+      }
+      case BinaryTag: {
+        std::unique_ptr<Expr> left = required(expr());
+        std::unique_ptr<Token> op =
+            token({GREATER, GREATER_EQUAL, LESS, LESS_EQUAL, BANG_EQUAL,
+                   EQUAL_EQUAL, MINUS, PLUS, SLASH, STAR, PERCENT});
+        return llox::make_expr<BinaryExpr>(left, op, required(expr()));
+      }
+      case CallTag: {
+        std::unique_ptr<Expr> callee = required(expr());
+        std::unique_ptr<Token> paren = token();
+        std::vector<std::unique_ptr<Expr>> arguments;
+        std::uint32_t count = u32();
+        for (std::uint32_t index = 0; index < count && isValid(); ++index)
+          arguments.push_back(required(expr()));
+        return llox::make_unique<CallExpr>(std::move(callee),
+                                           std::move(paren), arguments);
+      }
+      case GetTag: {
+        std::unique_ptr<Expr> object = required(expr());
+        return llox::make_expr<GetExpr>(object, token());
+      }
+      case GroupingTag:
+        return llox::make_expr<GroupingExpr>(required(expr()));
+      case BoolLiteralTag:
+        return llox::make_unique<BoolLiteralExpr>(u8() != 0);
+      case NilLiteralTag:
+        return llox::make_unique<NilLiteralExpr>();
+      case NumberLiteralTag: {
+        double value = 0;
+        raw(&value, sizeof(value));
+        return llox::make_unique<NumberLiteralExpr>(value);
+      }
+      case StringLiteralTag: {
+        std::string value = string();
+        return llox::make_unique<StringLiteralExpr>(value);
+      }
+      case LogicalTag: {
+        std::unique_ptr<Expr> left = required(expr());
+        std::unique_ptr<Token> op = token({AND, OR});
+        return llox::make_expr<LogicalExpr>(left, op, required(expr()));
+      }
+      case SetTag: {
+        std::unique_ptr<Expr> object = required(expr());
+        std::unique_ptr<Token> name = token();
+        return llox::make_expr<SetExpr>(object, name, required(expr()));
+      }
+      case SuperTag: {
+        std::unique_ptr<Token> keyword = token();
+        return llox::make_expr<SuperExpr>(keyword, token());
+      }
+      case ThisTag:
+        return llox::make_expr<ThisExpr>(token());
+      case UnaryTag: {
+        std::unique_ptr<Token> op = token({BANG, MINUS});
+        return llox::make_expr<UnaryExpr>(op, required(expr()));
+      }
+      case VariableTag:
+        return llox::make_expr<VariableExpr>(token());
+      default:
+        fail();
+        return nullptr;
+    }
+  }
+
+ private:
+  template <typename NodeT>
+  std::unique_ptr<NodeT> required(std::unique_ptr<NodeT> node) {
+    if (!node) fail();
+    return node;
+  }
+
+  std::unique_ptr<Token> token() {
+    std::uint8_t type = u8();
+    if (type == NullTag || type > END + 1) {
+      fail();
+      return nullptr;
+    }
+    unsigned int line = u32();
+    return llox::make_unique<Token>(static_cast<TokenType>(type - 1),
+                                    string(), line);
+  }
+
+  /// An operator token, which must be one of `types`.
+  std::unique_ptr<Token> token(std::initializer_list<TokenType> types) {
+    std::unique_ptr<Token> op = token();
+    if (op && std::find(types.begin(), types.end(), op->type) == types.end())
+      fail();
+    return op;
+  }
+};
+
+}  // namespace
+
+std::uint64_t ProgramCache::hashSource(std::string_view source) {
+  std::uint64_t hash = 0xcbf29ce484222325ull;
+  for (unsigned char c : source) {
+    hash ^= c;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+namespace {
+
+// Called by `dl_iterate_phdr` for the executable, which comes first, and
+// stores its GNU build ID, if it has one, in the view at `id`.
+int findBuildId(dl_phdr_info* info, std::size_t, void* id) {
+  for (int index = 0; index < info->dlpi_phnum; ++index) {
+    const ElfW(Phdr)& segment = info->dlpi_phdr[index];
+    if (segment.p_type != PT_NOTE) continue;
+
+    const char* note =
+        reinterpret_cast<const char*>(info->dlpi_addr + segment.p_vaddr);
+    const char* end = note + segment.p_memsz;
+    while (static_cast<std::size_t>(end - note) >= sizeof(ElfW(Nhdr))) {
+      const ElfW(Nhdr)* header = reinterpret_cast<const ElfW(Nhdr)*>(note);
+      const char* name = note + sizeof(ElfW(Nhdr));
+      const char* description = name + ((header->n_namesz + 3) & ~3u);
+      if (header->n_type == NT_GNU_BUILD_ID && header->n_namesz == 4 &&
+          std::memcmp(name, "GNU", 4) == 0) {
+        *static_cast<std::string_view*>(id) =
+            std::string_view(description, header->n_descsz);
+        return 1;
+      }
+      note = description + ((header->n_descsz + 3) & ~3u);
+    }
+  }
+  return 1;
+}
+
+}  // namespace
+
+std::uint64_t ProgramCache::buildIdentity() {
+  // Without a build ID, the whole executable is hashed, once.
+  static const std::uint64_t identity = [] {
+    std::string_view id;
+    dl_iterate_phdr(findBuildId, &id);
+    if (!id.empty()) return hashSource(id);
+    std::unique_ptr<SourceBuffer> executable =
+        SourceBuffer::open("/proc/self/exe");
+    return executable ? hashSource(executable->view()) : 0;
+  }();
+  return identity;
+}
+
+std::string ProgramCache::serialize(const Program& program,
+                                    std::uint64_t sourceHash) {
+  std::vector<const Stmt*> statements;
+  for (auto& stmt : program.getStatements()) statements.push_back(stmt.get());
+  return serialize(statements, sourceHash);
+}
+
+std::string ProgramCache::serialize(const std::vector<const Stmt*>& statements,
+                                    std::uint64_t sourceHash) {
+  Writer writer;
+  for (const Stmt* stmt : statements) writer.stmt(stmt);
+  if (!writer.complete) return std::string();
+
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kFormatVersion;
+  header.sourceHash = sourceHash;
+  header.buildIdentity = buildIdentity();
+  header.byteOrder = kByteOrderMark;
+  header.statementCount = statements.size();
+  header.nodesSize = writer.data.size();
+  header.stringsSize = writer.strings.size();
+
+  std::string image(reinterpret_cast<const char*>(&header), sizeof(header));
+  image.append(writer.data);
+  image.append(writer.strings);
+  return image;
+}
+
+std::unique_ptr<const Program> ProgramCache::deserialize(
+    const char* data, std::size_t size, std::uint64_t sourceHash) {
+  Header header;
+  if (size < sizeof(header)) return nullptr;
+  std::memcpy(&header, data, sizeof(header));
+
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kFormatVersion || header.sourceHash != sourceHash ||
+      header.buildIdentity != buildIdentity() ||
+      header.byteOrder != kByteOrderMark ||
+      header.nodesSize > size - sizeof(header) ||
+      header.stringsSize != size - sizeof(header) - header.nodesSize)
+    return nullptr;
+
+  const char* nodes = data + sizeof(header);
+  Reader reader(nodes, header.nodesSize, nodes + header.nodesSize,
+                header.stringsSize);
+  std::unique_ptr<StmtList> statements(new StmtList());
+  if (!reader.statements(header.statementCount, *statements) ||
+      !reader.finished())
+    return nullptr;
+
+  return llox::make_unique<Program>(std::move(statements));
+}
+
+std::unique_ptr<const Program> ProgramCache::load(const std::string& path,
+                                                  std::uint64_t sourceHash) {
+  LLOX_TRACE_SPAN(span, "load cached program");
+  std::unique_ptr<SourceBuffer> file = SourceBuffer::open(path.c_str());
+  if (!file) return nullptr;
+  LLOX_TRACE_ARG(span, "bytes", file->size());
+  return deserialize(file->data(), file->size(), sourceHash);
+}
+
+bool ProgramCache::store(const Program& program, std::uint64_t sourceHash,
+                         const std::string& path) {
+  LLOX_TRACE_SPAN(span, "store cached program");
+  std::string image = serialize(program, sourceHash);
+  if (image.empty()) return false;
+  LLOX_TRACE_ARG(span, "bytes", image.size());
+  return writeFileAtomically(path, image);
+}
@@ -0,0 +1,85 @@
+#include "lox/program.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "lox/parser.h"
+#include "lox/scanner.h"
+#include "lox/splitter.h"
+#include "lox/thread-pool.h"
+#include "lox/trace.h"
+
+using namespace llox;
+
+namespace {
+
+/// Pieces smaller than this are not worth a task of their own.
+constexpr std::size_t kMinimumPieceSize = 256 * 1024;
+
+}  // namespace
+
+static std::unique_ptr<const Program> compile(Scanner& scanner,
+                                              OutputSink& errors) {
+  // Scanning is driven by the parser, so the two share a span.
+  LLOX_TRACE_SPAN(span, "compile");
+  Parser parser(scanner, errors);
+  std::unique_ptr<StmtList> statements = parser.parse();
+  LLOX_TRACE_ARG(span, "tokens", scanner.tokenCount());
+  LLOX_TRACE_ARG(span, "statements", statements ? statements->size() : 0);
+  if (!statements || parser.hadError()) return nullptr;
+  return llox::make_unique<Program>(std::move(statements));
+}
+
+std::unique_ptr<const Program> Program::compile(const std::string& source,
+                                                OutputSink& errors) {
+  Scanner scanner(source, errors);
+  return ::compile(scanner, errors);
+}
+
+std::unique_ptr<const Program> Program::compile(const SourceBuffer& source,
+                                                OutputSink& errors) {
+  Scanner scanner(source, errors);
+  return ::compile(scanner, errors);
+}
+
+std::unique_ptr<const Program> Program::compile(const SourceBuffer& source,
+                                                ThreadPool& pool,
+                                                OutputSink& errors) {
+  LLOX_TRACE_SPAN(span, "compile in parallel");
+  std::size_t target = std::max(kMinimumPieceSize,
+                                source.size() / (4 * pool.size()) + 1);
+  std::vector<SourcePiece> pieces = splitStatements(source.view(), target);
+  if (pieces.size() < 2) return compile(source, errors);
+
+  struct Result {
+    std::unique_ptr<StmtList> statements;
+    StringOutputSink errors;
+    bool failed = false;
+  };
+  std::vector<Result> results(pieces.size());
+
+  for (std::size_t index = 0; index < pieces.size(); ++index) {
+    pool.submit([&pieces, &results, index] {
+      LLOX_TRACE_SPAN(span, "compile piece");
+      Result& result = results[index];
+      Scanner scanner(pieces[index].text, pieces[index].line, result.errors);
+      Parser parser(scanner, result.errors);
+      result.statements = parser.parse();
+      result.failed = parser.hadError();
+      LLOX_TRACE_ARG(span, "bytes", pieces[index].text.size());
+      LLOX_TRACE_ARG(span, "tokens", scanner.tokenCount());
+    });
+  }
+  pool.wait();
+
+  std::unique_ptr<StmtList> statements(new StmtList());
+  for (Result& result : results) {
+    if (result.failed || !result.errors.str().empty())
+      return compile(source, errors);
+    for (auto& stmt : *result.statements)
+      statements->push_back(std::move(stmt));
+  }
+  LLOX_TRACE_ARG(span, "pieces", pieces.size());
+  LLOX_TRACE_ARG(span, "statements", statements->size());
+  return llox::make_unique<Program>(std::move(statements));
+}
@@ -0,0 +1,86 @@
+#include "lox/region.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+using namespace llox;
+
+namespace {
+
+thread_local Region* activeRegion = nullptr;
+
+}  // namespace
+
+Region::~Region() {
+  while (chunks) {
+    Chunk* next = chunks->next;
+    std::free(chunks);
+    chunks = next;
+  }
+}
+
+void* Region::allocate(std::size_t size, std::size_t alignment) {
+  Chunk* chunk = chunks;
+
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    if (chunk) {
+      auto base = reinterpret_cast<std::uintptr_t>(chunk) + kHeaderSize;
+      std::uintptr_t address =
+          (base + chunk->used + alignment - 1) & ~(alignment - 1);
+      std::size_t end = address - base + size;
+      if (end <= chunk->size) {
+        bytesUsed += end - chunk->used;
+        chunk->used = end;
+        return reinterpret_cast<void*>(address);
+      }
+    }
+    chunk = grow(size + alignment);
+  }
+
+  return nullptr;
+}
+
+bool Region::contains(const void* pointer) const {
+  auto address = reinterpret_cast<std::uintptr_t>(pointer);
+  for (Chunk* chunk = chunks; chunk; chunk = chunk->next) {
+    auto base = reinterpret_cast<std::uintptr_t>(chunk) + kHeaderSize;
+    if (address >= base && address < base + chunk->size) return true;
+  }
+  return false;
+}
+
+Region* Region::active() { return activeRegion; }
+
+Region::Chunk* Region::grow(std::size_t minimumSize) {
+  std::size_t size = std::max(nextChunkSize, minimumSize);
+  nextChunkSize = std::min(nextChunkSize * 2, kMaxChunkSize);
+
+  void* memory = std::malloc(kHeaderSize + size);
+  if (!memory) throw std::bad_alloc();
+
+  Chunk* chunk = static_cast<Chunk*>(memory);
+  chunk->next = chunks;
+  chunk->size = size;
+  chunk->used = 0;
+  chunks = chunk;
+  bytesReserved += size;
+  return chunk;
+}
+
+RegionScope::RegionScope(Region* region) : previous(activeRegion) {
+  activeRegion = region;
+}
+
+RegionScope::~RegionScope() { activeRegion = previous; }
+
+void* RegionAllocated::operator new(std::size_t size) {
+  if (activeRegion) return activeRegion->allocate(size);
+  return ::operator new(size);
+}
+
+void RegionAllocated::operator delete(void* pointer) {
+  if (activeRegion && activeRegion->contains(pointer)) return;
+  ::operator delete(pointer);
+}
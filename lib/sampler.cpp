@@ -0,0 +1,111 @@
+#include "lox/sampler.h"
+
+#include <signal.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+
+using namespace llox;
+
+namespace {
+
+/// Room for this many frames, headers included, across all samples.
+constexpr std::size_t kBufferSize = 1 << 20;
+
+/// Each sample is a header frame, whose line holds the number of frames
+/// after it, followed by that many frames from the outermost call on.
+std::unique_ptr<ShadowFrame[]> buffer;
+std::atomic<std::size_t> used{0};
+std::atomic<std::size_t> dropped{0};
+std::atomic<bool> running{false};
+struct sigaction previous;
+
+/// The folded stacks and their sample counts.
+std::map<std::string, std::size_t> stacks;
+
+// Initial-exec, so that the signal handler reaches it without a call to
+// `__tls_get_addr`. lox is never loaded with `dlopen`.
+__attribute__((tls_model("initial-exec"))) thread_local ShadowStack
+    shadowStack;
+
+}  // namespace
+
+void Sampler::handleSignal(int) {
+  ShadowStack& stack = ShadowStack::current();
+  std::size_t depth = std::min(stack.depth.load(std::memory_order_relaxed),
+                               ShadowStack::kCapacity);
+  std::atomic_signal_fence(std::memory_order_acquire);
+
+  std::size_t at = used.fetch_add(depth + 1, std::memory_order_relaxed);
+  if (at + depth + 1 > kBufferSize) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  buffer[at] = {nullptr, static_cast<unsigned int>(depth)};
+  std::copy(stack.frames, stack.frames + depth, &buffer[at + 1]);
+}
+
+ShadowStack& ShadowStack::current() { return shadowStack; }
+
+bool Sampler::start(std::chrono::microseconds interval) {
+  if (running.exchange(true)) return false;
+  if (!buffer) buffer.reset(new ShadowFrame[kBufferSize]);
+  std::fill(&buffer[0], &buffer[kBufferSize], ShadowFrame{nullptr, 0});
+
+  struct sigaction action = {};
+  action.sa_handler = handleSignal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, &previous) != 0) {
+    running = false;
+    return false;
+  }
+
+  struct itimerval timer = {};
+  timer.it_interval.tv_sec = interval.count() / 1000000;
+  timer.it_interval.tv_usec = interval.count() % 1000000;
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+    sigaction(SIGPROF, &previous, nullptr);
+    running = false;
+    return false;
+  }
+  return true;
+}
+
+void Sampler::stop() {
+  if (!running.exchange(false)) return;
+
+  struct itimerval timer = {};
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  sigaction(SIGPROF, &previous, nullptr);
+
+  std::size_t end = std::min(used.load(), kBufferSize);
+  for (std::size_t at = 0; at < end;) {
+    std::size_t depth = buffer[at].line;
+    if (at + depth + 1 > end) break;
+    const ShadowFrame* frames = &buffer[at + 1];
+
+    // A sample still being written by another thread when the timer stopped
+    // may have empty frames.
+    std::string stack = "<script>";
+    for (std::size_t index = 0; index < depth && frames[index].function;
+         ++index) {
+      stack += ":" + std::to_string(frames[index].line) + ";" +
+               frames[index].function->name->lexeme;
+    }
+    stacks[stack] += 1;
+    at += depth + 1;
+  }
+  used = 0;
+}
+
+void Sampler::write(OutputSink& out) {
+  for (const auto& entry : stacks)
+    out.write(entry.first + " " + std::to_string(entry.second) + "\n");
+  if (std::size_t count = dropped.load())
+    out.write("[dropped] " + std::to_string(count) + "\n");
+}
@@ -1,10 +1,37 @@
 #include "lox/scanner.h"
 
-#include <iostream>
+#include <charconv>
+#include <limits>
 #include <memory>
 
 using namespace llox;
 
+// Looked up by `std::string_view`, without copying the identifier.
+typedef std::map<std::string, TokenType, std::less<>> KeywordMap;
+
+// Shared by every scanner; never modified after initialization.
+static const KeywordMap& keywords() {
+  static const auto* keywords = new KeywordMap{
+      {"and", AND},
+      {"class", CLASS},
+      {"else", ELSE},
+      {"false", FALSE},
+      {"for", FOR},
+      {"fun", FUN},
+      {"if", IF},
+      {"nil", NIL},
+      {"or", OR},
+      {"print", PRINT},
+      {"return", RETURN},
+      {"super", SUPER},
+      {"this", THIS},
+      {"true", TRUE},
+      {"var", VAR},
+      {"while", WHILE},
+  };
+  return *keywords;
+}
+
 void Scanner::scanToken() {
   char c = advance();
 
@@ -79,7 +106,7 @@ void Scanner::scanToken() {
       } else if (isAlpha(c)) {
         identifier();
       } else {
-        std::cerr << "error\n";
+        error();
       }
       break;
   }
@@ -95,6 +122,37 @@ std::unique_ptr<Scanner::TokenList> Scanner::scanTokens() {
   return std::move(tokens);
 }
 
+std::unique_ptr<Token> Scanner::next() {
+  while (tokens->empty()) {
+    // Drop the text of the tokens already returned once there is enough of
+    // it to be worth moving the rest.
+    if (input && current >= kChunkSize) {
+      window.erase(0, current);
+      source = window;
+      current = 0;
+    }
+
+    if (isAtEnd()) return llox::make_unique<Token>(TokenType::END, "", line);
+    start = current;
+    scanToken();
+  }
+
+  std::unique_ptr<Token> token = std::move(tokens->back());
+  tokens->pop_back();
+  return token;
+}
+
+bool Scanner::fill() {
+  if (!input) return false;
+
+  std::size_t size = window.size();
+  window.resize(size + kChunkSize);
+  input->read(&window[size], kChunkSize);
+  window.resize(size + input->gcount());
+  source = window;
+  return window.size() > size;
+}
+
 void Scanner::string() {
   while (peek() != '"' && !isAtEnd()) {
     if (peek() == '\n') line++;
@@ -103,7 +161,7 @@ void Scanner::string() {
 
   // Unterminated string.
   if (isAtEnd()) {
-    std::cerr << "error\n";
+    error();
     return;
   }
 
@@ -111,7 +169,7 @@ void Scanner::string() {
   advance();
 
   // Trim the surrounding quotes.
-  std::string value = source.substr(start + 1, current - start - 2);
+  std::string value(source.substr(start + 1, current - start - 2));
   addStringToken(value);
 }
 
@@ -126,19 +184,29 @@ void Scanner::number() {
     while (isDigit(peek())) advance();
   }
 
-  std::string value = source.substr(start, current - start);
-  addNumberToken(std::stod(value));
+  addNumberToken(numberValue(source.substr(start, current - start)));
+}
+
+double Scanner::numberValue(std::string_view lexeme) {
+  double value = 0;
+  std::from_chars_result result =
+      std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), value);
+  if (result.ec != std::errc::result_out_of_range) return value;
+  // There is no exponent, so only a nonzero integer part can overflow.
+  for (char c : lexeme.substr(0, lexeme.find('.')))
+    if (c != '0') return std::numeric_limits<double>::infinity();
+  return 0;
 }
 
 void Scanner::identifier() {
   while (isAlphaNumeric(peek())) advance();
 
   // See if the identifier is a reserved word.
-  std::string text = source.substr(start, current - start);
+  std::string_view text = source.substr(start, current - start);
 
   TokenType type = IDENTIFIER;
-  auto typeIt = keywords.find(text);
-  if (typeIt != keywords.end()) type = typeIt->second;
+  auto typeIt = keywords().find(text);
+  if (typeIt != keywords().end()) type = typeIt->second;
 
   addToken(type);
 }
@@ -0,0 +1,316 @@
+#include "lox/server.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <thread>
+
+#include "lox/program-cache.h"
+
+using namespace llox;
+
+namespace {
+
+/// Larger frames are taken to be garbage rather than allocated for.
+constexpr std::uint32_t kMaxFrameSize = 64 * 1024 * 1024;
+
+/// Frames are read this much at a time, so that a connection only takes as
+/// much memory as it has actually sent, whatever its header claims.
+constexpr std::size_t kFramePiece = 64 * 1024;
+
+struct FrameHeader {
+  std::uint8_t type;
+  std::uint32_t size;
+} __attribute__((packed));
+
+bool sendAll(int fd, const char* data, std::size_t size) {
+  while (size > 0) {
+    ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+bool receiveAll(int fd, char* data, std::size_t size) {
+  while (size > 0) {
+    ssize_t received = ::recv(fd, data, size, 0);
+    if (received < 0 && errno == EINTR) continue;
+    if (received <= 0) return false;
+    data += received;
+    size -= received;
+  }
+  return true;
+}
+
+bool socketAddress(const std::string& path, sockaddr_un& address) {
+  if (path.size() >= sizeof(address.sun_path)) return false;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+/// Makes blocking reads and writes on `fd` fail after `timeout`.
+void setTimeout(int fd, std::chrono::milliseconds timeout) {
+  if (timeout.count() <= 0) return;
+  timeval value;
+  value.tv_sec = timeout.count() / 1000;
+  value.tv_usec = timeout.count() % 1000 * 1000;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &value, sizeof(value));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &value, sizeof(value));
+}
+
+/// The client's side of a run. Once writing to it fails, the run is stopped
+/// the next time it yields, rather than computing output nobody will read.
+class Connection : public YieldHook {
+  YieldHook* next;
+
+ public:
+  int fd;
+  bool lost = false;
+
+  /// `next` is the hook the server was given, if any.
+  Connection(int fd, YieldHook* next) : next(next), fd(fd) {}
+
+  bool yield() override { return !lost && (!next || next->yield()); }
+};
+
+/// Buffers what a script prints and sends it to the client as frames of one
+/// type.
+class FrameOutputSink : public OutputSink {
+  Connection& connection;
+  FrameType type;
+  std::string buffer;
+
+ public:
+  static constexpr std::size_t kCapacity = 64 * 1024;
+
+  FrameOutputSink(Connection& connection, FrameType type)
+      : connection(connection), type(type) {}
+
+  using OutputSink::write;
+
+  void write(const char* data, std::size_t size) override {
+    buffer.append(data, size);
+    if (buffer.size() >= kCapacity) flush();
+  }
+
+  void flush() override {
+    if (buffer.empty()) return;
+    if (!connection.lost &&
+        !writeFrame(connection.fd, type, buffer.data(), buffer.size()))
+      connection.lost = true;
+    buffer.clear();
+  }
+};
+
+}  // namespace
+
+bool llox::writeFrame(int fd, FrameType type, const char* data,
+                      std::size_t size) {
+  // Small frames go out in a single system call.
+  FrameHeader header = {type, static_cast<std::uint32_t>(size)};
+  if (size <= 4096) {
+    char frame[sizeof(header) + 4096];
+    std::memcpy(frame, &header, sizeof(header));
+    std::memcpy(frame + sizeof(header), data, size);
+    return sendAll(fd, frame, sizeof(header) + size);
+  }
+  return sendAll(fd, reinterpret_cast<const char*>(&header), sizeof(header)) &&
+         sendAll(fd, data, size);
+}
+
+bool llox::readFrame(int fd, FrameType& type, std::string& payload) {
+  FrameHeader header;
+  if (!receiveAll(fd, reinterpret_cast<char*>(&header), sizeof(header)))
+    return false;
+  if (header.size > kMaxFrameSize) return false;
+  type = static_cast<FrameType>(header.type);
+  payload.clear();
+  while (payload.size() < header.size) {
+    std::size_t offset = payload.size();
+    std::size_t piece = std::min<std::size_t>(kFramePiece, header.size - offset);
+    payload.resize(offset + piece);
+    if (!receiveAll(fd, &payload[offset], piece)) return false;
+  }
+  return true;
+}
+
+Server::Server(const ServerOptions& options)
+    : options(options), pool(options.jobs) {}
+
+Server::~Server() {
+  if (listener >= 0) close(listener);
+}
+
+bool Server::listen(const std::string& path) {
+  sockaddr_un address;
+  if (!socketAddress(path, address)) return false;
+
+  listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener < 0) return false;
+
+  // Only a socket can be left over from an earlier server; anything else at
+  // `path` is not ours to remove, and makes the bind fail.
+  struct stat status;
+  if (lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+    unlink(path.c_str());
+  return bind(listener, reinterpret_cast<sockaddr*>(&address),
+              sizeof(address)) == 0 &&
+         ::listen(listener, SOMAXCONN) == 0;
+}
+
+void Server::serve() {
+  for (;;) {
+    int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      return;
+    }
+    setTimeout(fd, options.timeout);
+    if (connections >= options.maxConnections) {
+      reject(fd);
+      close(fd);
+      continue;
+    }
+    connections += 1;
+    std::thread([this, fd] {
+      handle(fd);
+      close(fd);
+      connections -= 1;
+    }).detach();
+  }
+}
+
+void Server::reject(int fd) {
+  // The frames are small enough to fit in the socket's buffer, so this does
+  // not wait for the client, and it has not sent its script yet.
+  static const char message[] = "error: The server is busy.\n";
+  std::uint32_t status = kBusyStatus;
+  if (writeFrame(fd, ErrorFrame, message, sizeof(message) - 1))
+    writeFrame(fd, ExitFrame, reinterpret_cast<const char*>(&status),
+               sizeof(status));
+}
+
+void Server::handle(int fd) {
+  FrameType type;
+  std::string source;
+  while (readFrame(fd, type, source) && type == RunFrame) {
+    // Only the run itself takes a worker; this thread waits for it, since
+    // the exchanges on a connection happen one after another.
+    std::promise<bool> ran;
+    std::future<bool> connected = ran.get_future();
+    pool.submit([this, fd, &source, &ran] { ran.set_value(run(fd, source)); });
+    if (!connected.get()) return;
+  }
+}
+
+bool Server::run(int fd, const std::string& source) {
+  Connection connection(fd, options.interpreter.budget.yield);
+  FrameOutputSink output(connection, OutputFrame);
+  FrameOutputSink errors(connection, ErrorFrame);
+
+  std::uint32_t status = 0;
+  std::shared_ptr<const Program> program = compile(source, errors);
+  if (program) {
+    InterpreterOptions interpreterOptions = options.interpreter;
+    interpreterOptions.output = &output;
+    interpreterOptions.errors = &errors;
+    interpreterOptions.budget.yield = &connection;
+    Interpreter interpreter(interpreterOptions);
+    if (!interpreter.interpret(*program)) status = kRuntimeErrorStatus;
+  } else {
+    status = kSyntaxErrorStatus;
+  }
+
+  output.flush();
+  errors.flush();
+  return !connection.lost &&
+         writeFrame(fd, ExitFrame, reinterpret_cast<const char*>(&status),
+                    sizeof(status));
+}
+
+std::shared_ptr<const Program> Server::compile(const std::string& source,
+                                               OutputSink& errors) {
+  std::uint64_t hash = ProgramCache::hashSource(source);
+  {
+    std::lock_guard<std::mutex> guard(cacheLock);
+    auto found = cache.find(hash);
+    if (found != cache.end() && found->second.source == source) {
+      recent.splice(recent.begin(), recent, found->second.use);
+      return found->second.program;
+    }
+  }
+
+  // Compile outside the lock. Two requests racing on the same new source
+  // both compile it, and the second result replaces the first.
+  std::shared_ptr<const Program> program = Program::compile(source, errors);
+  if (!program) return nullptr;
+
+  std::lock_guard<std::mutex> guard(cacheLock);
+  auto found = cache.find(hash);
+  if (found != cache.end()) {
+    recent.erase(found->second.use);
+    cache.erase(found);
+  } else if (cache.size() >= kMaxCachedPrograms) {
+    cache.erase(recent.back());
+    recent.pop_back();
+  }
+  recent.push_front(hash);
+  cache[hash] = CachedProgram{source, program, recent.begin()};
+  return program;
+}
+
+Client::~Client() {
+  if (fd >= 0) close(fd);
+}
+
+bool Client::connect(const std::string& path) {
+  sockaddr_un address;
+  if (!socketAddress(path, address)) return false;
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return false;
+  return ::connect(fd, reinterpret_cast<sockaddr*>(&address),
+                   sizeof(address)) == 0;
+}
+
+int Client::run(const SourceBuffer& source, OutputSink& output,
+                OutputSink& errors) {
+  // A busy server answers and closes the connection without reading the
+  // script, which can make sending it fail, so the answer is read anyway.
+  writeFrame(fd, RunFrame, source.data(), source.size());
+
+  FrameType type;
+  std::string payload;
+  while (readFrame(fd, type, payload)) {
+    switch (type) {
+      case OutputFrame:
+        output.write(payload);
+        break;
+      case ErrorFrame:
+        errors.write(payload);
+        break;
+      case ExitFrame: {
+        std::uint32_t status = 0;
+        if (payload.size() != sizeof(status)) return -1;
+        std::memcpy(&status, payload.data(), sizeof(status));
+        return status;
+      }
+      default:
+        return -1;
+    }
+  }
+  return -1;
+}
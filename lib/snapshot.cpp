@@ -0,0 +1,230 @@
+#include "lox/snapshot.h"
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "lox/binary-file.h"
+#include "lox/program-cache.h"
+#include "lox/source-buffer.h"
+#include "lox/trace.h"
+
+using namespace llox;
+
+namespace {
+
+const char kMagic[4] = {'L', 'O', 'X', 'S'};
+
+struct Header {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t byteOrder;
+  std::uint32_t objectCount;
+  std::uint64_t recordsSize;
+  std::uint64_t stringsSize;
+  std::uint64_t functionsSize;
+};
+
+/// Writes the records of an image to `data`.
+class Writer : public BinaryWriter {
+ public:
+  /// The declarations of the functions written so far, each once.
+  std::vector<const Stmt*> functions;
+
+  void object(const Object* object, const std::vector<std::string>& names) {
+    u8(object->kind);
+    switch (object->kind) {
+      case BoolKind:
+        u8(static_cast<const Bool*>(object)->value);
+        break;
+      case NumberKind:
+        raw(&static_cast<const Number*>(object)->value, sizeof(double));
+        break;
+      case NilKind:
+        break;
+      case StringKind: {
+        // Ropes are written out without flattening them in the heap.
+        std::string characters;
+        static_cast<const String*>(object)->appendTo(characters);
+        string(characters);
+        break;
+      }
+      case FunctionKind: {
+        const FunctionStmt* declaration =
+            static_cast<const Function*>(object)->declaration;
+        auto inserted = functionIndex.emplace(declaration, functions.size());
+        if (inserted.second) functions.push_back(declaration);
+        u32(inserted.first->second);
+        break;
+      }
+    }
+    u32(names.size());
+    for (const std::string& name : names) string(name);
+  }
+
+ private:
+  std::unordered_map<const FunctionStmt*, std::uint32_t> functionIndex;
+};
+
+/// Decodes the records of an image. Without a heap it only checks them.
+class Reader : public BinaryReader {
+  const StmtList& functions;
+  Heap* heap;
+  Environment* globals;
+
+ public:
+  Reader(const char* records, std::size_t recordsSize, const char* strings,
+         std::size_t stringsSize, const StmtList& functions, Heap* heap,
+         Environment* globals)
+      : BinaryReader(records, recordsSize, strings, stringsSize),
+        functions(functions),
+        heap(heap),
+        globals(globals) {}
+
+  bool read(std::uint32_t objectCount) {
+    for (std::uint32_t index = 0; index < objectCount && isValid(); ++index) {
+      // Each object is bound as soon as it exists, which keeps it rooted
+      // across the allocation of the next one.
+      Object* object = this->object();
+      std::uint32_t names = u32();
+      for (std::uint32_t name = 0; name < names && isValid(); ++name) {
+        std::string value = string();
+        if (globals && isValid()) globals->define(value, object);
+      }
+    }
+    return finished();
+  }
+
+ private:
+  Object* object() {
+    switch (u8()) {
+      case BoolKind: {
+        bool value = u8() != 0;
+        return heap ? heap->boolean(value) : nullptr;
+      }
+      case NumberKind: {
+        double value = 0;
+        raw(&value, sizeof(value));
+        return heap && isValid() ? heap->allocate<Number>(value) : nullptr;
+      }
+      case NilKind:
+        return heap ? heap->nil() : nullptr;
+      case StringKind: {
+        std::string value = string();
+        return heap && isValid() ? heap->allocate<String>(value) : nullptr;
+      }
+      case FunctionKind: {
+        std::uint32_t index = u32();
+        if (!isValid() || index >= functions.size() ||
+            functions[index]->kind != Stmt::FunctionStmtKind) {
+          fail();
+          return nullptr;
+        }
+        const Stmt* declaration = functions[index].get();
+        return heap ? heap->allocate<Function>(
+                          static_cast<const FunctionStmt*>(declaration))
+                    : nullptr;
+      }
+      default:
+        fail();
+        return nullptr;
+    }
+  }
+};
+
+}  // namespace
+
+std::string Snapshot::serialize(const Environment& globals) {
+  // Group the names by the object they are bound to, in order of first use.
+  std::vector<const Object*> objects;
+  std::unordered_map<const Object*, std::vector<std::string>> names;
+  for (auto& entry : globals.getValues()) {
+    if (!entry.second) continue;
+    std::vector<std::string>& bound = names[entry.second];
+    if (bound.empty()) objects.push_back(entry.second);
+    bound.push_back(entry.first);
+  }
+
+  Writer writer;
+  for (const Object* object : objects) writer.object(object, names[object]);
+
+  // Functions refer into the AST of the program that declared them, so the
+  // image carries a copy of their declarations.
+  std::string functions;
+  if (!writer.functions.empty()) {
+    functions = ProgramCache::serialize(writer.functions, 0);
+    if (functions.empty()) return std::string();
+  }
+
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kFormatVersion;
+  header.byteOrder = kByteOrderMark;
+  header.objectCount = objects.size();
+  header.recordsSize = writer.data.size();
+  header.stringsSize = writer.strings.size();
+  header.functionsSize = functions.size();
+
+  std::string image(reinterpret_cast<const char*>(&header), sizeof(header));
+  image.append(writer.data);
+  image.append(writer.strings);
+  image.append(functions);
+  return image;
+}
+
+bool Snapshot::deserialize(const char* data, std::size_t size, Heap& heap,
+                           Environment& globals,
+                           std::unique_ptr<const Program>& declarations) {
+  Header header;
+  if (size < sizeof(header)) return false;
+  std::memcpy(&header, data, sizeof(header));
+
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kFormatVersion || header.byteOrder != kByteOrderMark ||
+      header.recordsSize > size - sizeof(header) ||
+      header.stringsSize > size - sizeof(header) - header.recordsSize ||
+      header.functionsSize != size - sizeof(header) - header.recordsSize -
+                                  header.stringsSize)
+    return false;
+
+  const char* records = data + sizeof(header);
+  const char* strings = records + header.recordsSize;
+  const char* functions = strings + header.stringsSize;
+
+  std::unique_ptr<const Program> program;
+  if (header.functionsSize > 0) {
+    program = ProgramCache::deserialize(functions, header.functionsSize, 0);
+    if (!program) return false;
+  } else {
+    program = llox::make_unique<Program>(llox::make_unique<StmtList>());
+  }
+
+  // Check the whole image before allocating anything, so that a bad image
+  // leaves the heap and the globals untouched.
+  Reader check(records, header.recordsSize, strings, header.stringsSize,
+               program->getStatements(), nullptr, nullptr);
+  if (!check.read(header.objectCount)) return false;
+
+  Reader reader(records, header.recordsSize, strings, header.stringsSize,
+                program->getStatements(), &heap, &globals);
+  if (!reader.read(header.objectCount)) return false;
+  declarations = std::move(program);
+  return true;
+}
+
+bool Snapshot::save(const Environment& globals, const std::string& path) {
+  LLOX_TRACE_SPAN(span, "save snapshot");
+  std::string image = serialize(globals);
+  if (image.empty()) return false;
+  LLOX_TRACE_ARG(span, "bytes", image.size());
+  return writeFileAtomically(path, image);
+}
+
+bool Snapshot::load(const std::string& path, Heap& heap, Environment& globals,
+                    std::unique_ptr<const Program>& declarations) {
+  LLOX_TRACE_SPAN(span, "load snapshot");
+  std::unique_ptr<SourceBuffer> file = SourceBuffer::open(path.c_str());
+  if (!file) return false;
+  LLOX_TRACE_ARG(span, "bytes", file->size());
+  return deserialize(file->data(), file->size(), heap, globals, declarations);
+}
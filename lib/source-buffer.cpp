@@ -0,0 +1,67 @@
+#include "lox/source-buffer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+using namespace llox;
+
+SourceBuffer::SourceBuffer(std::string text) : owned(std::move(text)) {
+  bytes = owned.data();
+  length = owned.size();
+}
+
+SourceBuffer::~SourceBuffer() {
+  if (mapping) munmap(mapping, mappingSize);
+}
+
+std::unique_ptr<SourceBuffer> SourceBuffer::open(const char* path) {
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return nullptr;
+  std::unique_ptr<SourceBuffer> buffer = read(fd);
+  close(fd);
+  return buffer;
+}
+
+std::unique_ptr<SourceBuffer> SourceBuffer::read(int fd) {
+  std::unique_ptr<SourceBuffer> buffer(new SourceBuffer());
+
+  // The whole file is mapped, since a mapping must start on a page boundary,
+  // but the buffer only covers what a read would have returned.
+  struct stat status;
+  off_t offset = lseek(fd, 0, SEEK_CUR);
+  if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && offset >= 0 &&
+      offset < status.st_size) {
+    void* mapping =
+        mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      madvise(mapping, status.st_size, MADV_SEQUENTIAL);
+      lseek(fd, status.st_size, SEEK_SET);
+      buffer->mapping = mapping;
+      buffer->mappingSize = status.st_size;
+      buffer->bytes = static_cast<const char*>(mapping) + offset;
+      buffer->length = status.st_size - offset;
+      return buffer;
+    }
+  }
+
+  std::string& text = buffer->owned;
+  for (;;) {
+    std::size_t size = text.size();
+    text.resize(size + 64 * 1024);
+    ssize_t count = ::read(fd, &text[size], text.size() - size);
+    if (count < 0) {
+      text.resize(size);
+      if (errno == EINTR) continue;
+      return nullptr;
+    }
+    text.resize(size + count);
+    if (count == 0) break;
+  }
+  buffer->bytes = text.data();
+  buffer->length = text.size();
+  return buffer;
+}
@@ -0,0 +1,95 @@
+#include "lox/splitter.h"
+
+using namespace llox;
+
+namespace {
+
+bool isIdentifierChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+/// The index of the first character at or after `index` that is neither a
+/// blank nor part of a `//` comment.
+std::size_t skipBlanks(std::string_view source, std::size_t index) {
+  std::size_t size = source.size();
+  while (index < size) {
+    if (source[index] == ' ' || source[index] == '\t' ||
+        source[index] == '\r' || source[index] == '\n') {
+      index += 1;
+    } else if (source[index] == '/' && index + 1 < size &&
+               source[index + 1] == '/') {
+      while (index < size && source[index] != '\n') index += 1;
+    } else {
+      break;
+    }
+  }
+  return index;
+}
+
+}  // namespace
+
+std::vector<SourcePiece> llox::splitStatements(std::string_view source,
+                                               std::size_t target,
+                                               unsigned int line,
+                                               std::size_t* rest) {
+  std::vector<SourcePiece> pieces;
+  std::size_t begin = 0;
+  unsigned int beginLine = line;
+  long depth = 0;
+
+  std::size_t size = source.size();
+  for (std::size_t index = 0; index < size; ++index) {
+    char c = source[index];
+    switch (c) {
+      case '\n':
+        line += 1;
+        continue;
+      case '"':
+        for (++index; index < size && source[index] != '"'; ++index)
+          if (source[index] == '\n') line += 1;
+        continue;
+      case '/':
+        if (index + 1 < size && source[index + 1] == '/')
+          while (index + 1 < size && source[index + 1] != '\n') ++index;
+        continue;
+      case '(':
+      case '{':
+        depth += 1;
+        continue;
+      case ')':
+        depth -= 1;
+        continue;
+      case '}':
+        depth -= 1;
+        break;
+      case ';':
+        break;
+      default:
+        continue;
+    }
+
+    if (depth != 0 || index + 1 - begin < target) continue;
+
+    if (startsWithElse(source.substr(index + 1))) continue;
+
+    pieces.push_back({source.substr(begin, index + 1 - begin), beginLine});
+    begin = index + 1;
+    beginLine = line;
+  }
+
+  if (rest) *rest = begin;
+  if (begin < size || pieces.empty())
+    pieces.push_back({source.substr(begin), beginLine});
+  return pieces;
+}
+
+bool llox::isBlank(std::string_view source) {
+  return skipBlanks(source, 0) == source.size();
+}
+
+bool llox::startsWithElse(std::string_view source) {
+  std::size_t next = skipBlanks(source, 0);
+  return source.substr(next, 4) == "else" &&
+         (next + 4 == source.size() || !isIdentifierChar(source[next + 4]));
+}
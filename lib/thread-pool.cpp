@@ -0,0 +1,105 @@
+#include "lox/thread-pool.h"
+
+#include <algorithm>
+
+using namespace llox;
+
+namespace {
+
+/// The pool and deque index of the worker running on this thread, if any.
+thread_local const ThreadPool* currentPool = nullptr;
+thread_local std::size_t currentIndex = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(unsigned size) {
+  if (size == 0) size = std::max(1u, std::thread::hardware_concurrency());
+
+  for (unsigned index = 0; index < size; ++index)
+    workers.emplace_back(new Worker());
+  for (unsigned index = 0; index < size; ++index)
+    threads.emplace_back([this, index] { work(index); });
+}
+
+ThreadPool::~ThreadPool() {
+  wait();
+  {
+    std::lock_guard<std::mutex> guard(idleLock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread& thread : threads) thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  std::size_t index = currentPool == this
+                          ? currentIndex
+                          : nextWorker.fetch_add(1) % workers.size();
+
+  pending.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> guard(workers[index]->lock);
+    workers[index]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> guard(idleLock);
+    queued += 1;
+  }
+  wake.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(idleLock);
+  done.wait(lock, [this] { return pending.load() == 0; });
+}
+
+void ThreadPool::work(std::size_t index) {
+  currentPool = this;
+  currentIndex = index;
+
+  for (;;) {
+    std::function<void()> task;
+    if (take(index, task)) {
+      task();
+      if (pending.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> guard(idleLock);
+        done.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(idleLock);
+    wake.wait(lock, [this] { return stopping || queued > 0; });
+    if (stopping && queued == 0) return;
+  }
+}
+
+bool ThreadPool::take(std::size_t index, std::function<void()>& task) {
+  bool found = false;
+
+  {
+    Worker& own = *workers[index];
+    std::lock_guard<std::mutex> guard(own.lock);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      found = true;
+    }
+  }
+
+  for (std::size_t offset = 1; !found && offset < workers.size(); ++offset) {
+    Worker& victim = *workers[(index + offset) % workers.size()];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      found = true;
+    }
+  }
+
+  if (found) {
+    std::lock_guard<std::mutex> guard(idleLock);
+    queued -= 1;
+  }
+  return found;
+}
@@ -0,0 +1,87 @@
+#include "lox/trace.h"
+
+#include <unistd.h>
+
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+using namespace llox;
+
+std::atomic<bool> Trace::recording{false};
+
+namespace {
+
+struct Event {
+  const char* name;
+  std::int64_t start;
+  std::int64_t duration;
+  unsigned int thread;
+  std::vector<std::pair<const char*, std::uint64_t>> args;
+};
+
+std::mutex lock;
+std::vector<Event> events;
+std::chrono::steady_clock::time_point origin;
+std::atomic<unsigned int> threads{0};
+
+/// A small number naming the calling thread's track.
+unsigned int threadId() {
+  static thread_local unsigned int id = ++threads;
+  return id;
+}
+
+std::int64_t microseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+}  // namespace
+
+void Trace::start() {
+  std::lock_guard<std::mutex> guard(lock);
+  origin = std::chrono::steady_clock::now();
+  events.clear();
+  recording = true;
+}
+
+void Trace::record(const char* name,
+                   std::chrono::steady_clock::time_point start,
+                   std::chrono::steady_clock::time_point end, const Arg* args,
+                   std::size_t argCount) {
+  Event event{name, 0, microseconds(end - start), threadId(), {}};
+  for (std::size_t index = 0; index < argCount; ++index)
+    event.args.emplace_back(args[index].name, args[index].value);
+
+  std::lock_guard<std::mutex> guard(lock);
+  if (!recording) return;
+  event.start = microseconds(start - origin);
+  events.push_back(std::move(event));
+}
+
+bool Trace::write(const std::string& path) {
+  std::lock_guard<std::mutex> guard(lock);
+  recording = false;
+
+  std::ofstream out(path, std::ios::binary);
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  const char* separator = "\n";
+  for (const Event& event : events) {
+    out << separator << "{\"name\":\"" << event.name
+        << "\",\"cat\":\"lox\",\"ph\":\"X\",\"ts\":" << event.start
+        << ",\"dur\":" << event.duration << ",\"pid\":" << getpid()
+        << ",\"tid\":" << event.thread;
+    if (!event.args.empty()) {
+      out << ",\"args\":{";
+      for (std::size_t index = 0; index < event.args.size(); ++index) {
+        out << (index ? "," : "") << "\"" << event.args[index].first
+            << "\":" << event.args[index].second;
+      }
+      out << "}";
+    }
+    out << "}";
+    separator = ",\n";
+  }
+  out << "\n]}\n";
+  return static_cast<bool>(out.flush());
+}
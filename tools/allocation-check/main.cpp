@@ -0,0 +1,81 @@
+// Checks that the last statement of a script allocates nothing once the
+// statements before it have run.
+//
+//   allocation_check [--iterations=N] <script>
+//
+// Runs every statement of the script once, then the last one N more times
+// within an `AllocationCheck`; the first run may still grow the
+// interpreter's buffers. This binary replaces the global
+// `operator new`, so the check sees every allocation, not only those that
+// `MemoryStats` counts by category. Prints "ok" on success; otherwise the
+// check reports the allocations and aborts.
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "lox/interpreter.h"
+#include "lox/memory-stats.h"
+#include "lox/output.h"
+#include "lox/program.h"
+#include "lox/source-buffer.h"
+
+ABSL_FLAG(int32_t, iterations, 10000,
+          "The number of times to run the last statement.");
+
+void* operator new(std::size_t size) {
+  llox::MemoryStats::countOperatorNew();
+  if (void* memory = std::malloc(size ? size : 1)) return memory;
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+
+void operator delete[](void* memory) noexcept { std::free(memory); }
+
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+
+void operator delete[](void* memory, std::size_t) noexcept {
+  std::free(memory);
+}
+
+int main(int argc, char** argv) {
+  std::vector<char*> arguments = absl::ParseCommandLine(argc, argv);
+  if (arguments.size() != 2) {
+    std::cerr << "usage: " << arguments[0] << " [--iterations=N] <script>\n";
+    return 1;
+  }
+  std::unique_ptr<llox::SourceBuffer> source =
+      llox::SourceBuffer::open(arguments[1]);
+  if (!source) {
+    std::cerr << "error: cannot read '" << arguments[1] << "'\n";
+    return 1;
+  }
+
+  std::unique_ptr<const llox::Program> program =
+      llox::Program::compile(*source, llox::standardError());
+  if (!program || program->getStatements().empty()) return 1;
+  const llox::StmtList& statements = program->getStatements();
+
+  llox::StringOutputSink output;
+  llox::InterpreterOptions options;
+  options.output = &output;
+  llox::Interpreter interpreter(options);
+  for (auto& stmt : statements) interpreter.interpret(*stmt);
+
+  const llox::Stmt& last = *statements.back();
+  llox::AllocationCheck check;
+  for (int32_t round = 0; round < absl::GetFlag(FLAGS_iterations); ++round)
+    interpreter.interpret(last);
+  check.assertNone("the last statement");
+
+  std::cout << "ok\n";
+  return 0;
+}
@@ -0,0 +1,348 @@
+// Checks that a `Document` edited in place parses just like its whole text.
+//
+//   document_check [--edits=N] [--seed=S] <script>
+//
+// Each round makes one edit to the script, compares the statements of the
+// document with a full parse of the new text, then undoes the edit and
+// compares again. Half of the edits are random byte ranges and half move
+// whole lines, which keeps many of the results free of syntax errors. Line
+// numbers are left out of the comparison, since the document does not
+// update them in statements it did not reparse. Prints "ok" on success, or
+// the first edit that went wrong.
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "lox/ast.h"
+#include "lox/document.h"
+#include "lox/interpreter.h"
+#include "lox/output.h"
+#include "lox/parser.h"
+#include "lox/program.h"
+#include "lox/source-buffer.h"
+
+ABSL_FLAG(int32_t, edits, 1000, "The number of edits to make.");
+ABSL_FLAG(uint32_t, seed, 1, "Seeds the choice of edits.");
+
+namespace {
+
+struct Edit {
+  std::size_t offset;
+  std::size_t length;
+  std::string replacement;
+};
+
+/// Writes out a syntax tree as nested lists of node names and lexemes,
+/// leaving out line numbers.
+class ShapePrinter : public llox::ExprVisitor, public llox::StmtVisitor {
+  std::string shape;
+
+ public:
+  std::string print(const std::vector<const llox::Stmt*>& statements) {
+    shape.clear();
+    for (const llox::Stmt* stmt : statements) this->stmt(stmt);
+    return shape;
+  }
+
+  void visit(const llox::AssignExpr* expr) override {
+    open("assign", expr->name.get());
+    this->expr(expr->value.get());
+    close();
+  }
+
+  void visit(const llox::BinaryExpr* expr) override {
+    open("binary", expr->op.get());
+    this->expr(expr->left.get());
+    this->expr(expr->right.get());
+    close();
+  }
+
+  void visit(const llox::CallExpr* expr) override {
+    open("call");
+    this->expr(expr->callee.get());
+    for (auto& argument : expr->arguments) this->expr(argument.get());
+    close();
+  }
+
+  void visit(const llox::GetExpr* expr) override {
+    open("get", expr->name.get());
+    this->expr(expr->object.get());
+    close();
+  }
+
+  void visit(const llox::GroupingExpr* expr) override {
+    open("group");
+    this->expr(expr->expression.get());
+    close();
+  }
+
+  void visit(const llox::BoolLiteralExpr* expr) override {
+    shape += expr->value ? " true" : " false";
+  }
+
+  void visit(const llox::NilLiteralExpr* expr) override { shape += " nil"; }
+
+  void visit(const llox::NumberLiteralExpr* expr) override {
+    shape += " " + std::to_string(expr->value);
+  }
+
+  void visit(const llox::StringLiteralExpr* expr) override {
+    shape += " \"" + expr->value + "\"";
+  }
+
+  void visit(const llox::LogicalExpr* expr) override {
+    open("logical", expr->op.get());
+    this->expr(expr->left.get());
+    this->expr(expr->right.get());
+    close();
+  }
+
+  void visit(const llox::SetExpr* expr) override {
+    open("set", expr->name.get());
+    this->expr(expr->object.get());
+    this->expr(expr->value.get());
+    close();
+  }
+
+  void visit(const llox::SuperExpr* expr) override {
+    open("super", expr->method.get());
+    close();
+  }
+
+  void visit(const llox::ThisExpr* expr) override { shape += " this"; }
+
+  void visit(const llox::UnaryExpr* expr) override {
+    open("unary", expr->op.get());
+    this->expr(expr->right.get());
+    close();
+  }
+
+  void visit(const llox::VariableExpr* expr) override {
+    shape += " " + expr->name->lexeme;
+  }
+
+  void visit(const llox::BlockStmt* stmt) override {
+    open("block");
+    for (auto& statement : stmt->statements) this->stmt(statement.get());
+    close();
+  }
+
+  void visit(const llox::ClassStmt* stmt) override {
+    open("class", stmt->name.get());
+    expr(stmt->superclass.get());
+    for (auto& method : stmt->methods) this->stmt(method.get());
+    close();
+  }
+
+  void visit(const llox::ExpressionStmt* stmt) override {
+    open("expression");
+    expr(stmt->expression.get());
+    close();
+  }
+
+  void visit(const llox::FunctionStmt* stmt) override {
+    open("fun", stmt->name.get());
+    for (auto& parameter : stmt->parameters)
+      shape += " " + parameter->lexeme;
+    if (const llox::StmtList* body = llox::Parser::functionBody(*stmt))
+      for (auto& statement : *body) this->stmt(statement.get());
+    else
+      shape += " <error>";
+    close();
+  }
+
+  void visit(const llox::IfStmt* stmt) override {
+    open("if");
+    expr(stmt->condition.get());
+    this->stmt(stmt->thenBranch.get());
+    this->stmt(stmt->elseBranch.get());
+    close();
+  }
+
+  void visit(const llox::PrintStmt* stmt) override {
+    open("print");
+    expr(stmt->expression.get());
+    close();
+  }
+
+  void visit(const llox::ReturnStmt* stmt) override {
+    open("return");
+    expr(stmt->value.get());
+    close();
+  }
+
+  void visit(const llox::VarStmt* stmt) override {
+    open("var", stmt->name.get());
+    expr(stmt->initializer.get());
+    close();
+  }
+
+  void visit(const llox::WhileStmt* stmt) override {
+    open("while");
+    expr(stmt->condition.get());
+    this->stmt(stmt->body.get());
+    close();
+  }
+
+ private:
+  void expr(const llox::Expr* expr) {
+    if (expr)
+      expr->accept(*this);
+    else
+      shape += " -";
+  }
+
+  void stmt(const llox::Stmt* stmt) {
+    if (stmt)
+      stmt->accept(*this);
+    else
+      shape += " -";
+  }
+
+  void open(const char* name, const llox::Token* token = nullptr) {
+    shape += " (";
+    shape += name;
+    if (token) shape += " " + token->lexeme;
+  }
+
+  void close() { shape += ")"; }
+};
+
+/// The shape of the document's statements, or "<error>" if it has syntax
+/// errors.
+std::string shapeOf(const llox::Document& document) {
+  if (document.hadError()) return "<error>";
+  return ShapePrinter().print(document.getStatements());
+}
+
+/// The shape of a full parse of `text`, as by `shapeOf`.
+std::string shapeOf(const std::string& text) {
+  llox::StringOutputSink errors;
+  std::unique_ptr<const llox::Program> program =
+      llox::Program::compile(text, errors);
+  if (!program) return "<error>";
+  std::vector<const llox::Stmt*> statements;
+  for (auto& stmt : program->getStatements()) statements.push_back(stmt.get());
+  return ShapePrinter().print(statements);
+}
+
+/// The offsets at which the lines of `text` begin, and its size.
+std::vector<std::size_t> lineStarts(const std::string& text) {
+  std::vector<std::size_t> starts = {0};
+  for (std::size_t index = 0; index < text.size(); ++index)
+    if (text[index] == '\n') starts.push_back(index + 1);
+  if (starts.back() != text.size()) starts.push_back(text.size());
+  return starts;
+}
+
+Edit randomEdit(const std::string& text, const std::string& original,
+                std::mt19937& random) {
+  auto below = [&random](std::size_t bound) {
+    return std::uniform_int_distribution<std::size_t>(0, bound)(random);
+  };
+
+  Edit edit;
+  if (random() % 2 == 0) {
+    edit.offset = below(text.size());
+    edit.length = below(std::min<std::size_t>(16, text.size() - edit.offset));
+    std::size_t from = below(original.size());
+    edit.replacement = original.substr(
+        from, below(std::min<std::size_t>(24, original.size() - from)));
+    return edit;
+  }
+
+  std::vector<std::size_t> lines = lineStarts(text);
+  std::size_t first = below(lines.size() - 1);
+  std::size_t last = first + below(std::min<std::size_t>(
+                                 3, lines.size() - 1 - first));
+  edit.offset = lines[first];
+  edit.length = lines[last] - lines[first];
+
+  std::vector<std::size_t> sources = lineStarts(original);
+  std::size_t from = below(sources.size() - 1);
+  std::size_t to =
+      from + below(std::min<std::size_t>(3, sources.size() - 1 - from));
+  edit.replacement = original.substr(sources[from], sources[to] - sources[from]);
+  return edit;
+}
+
+/// Applies `edit` to `document` and `text`, and returns false if the
+/// document no longer matches a full parse of the text.
+bool apply(const Edit& edit, llox::Document& document, std::string& text) {
+  document.edit(edit.offset, edit.length, edit.replacement);
+  text.replace(edit.offset, edit.length, edit.replacement);
+  return document.getText() == text && shapeOf(document) == shapeOf(text);
+}
+
+void report(const Edit& edit, const std::string& text) {
+  std::cout << "mismatch after replacing " << edit.length << " bytes at "
+            << edit.offset << " with \"" << edit.replacement
+            << "\"; the text is now:\n"
+            << text;
+}
+
+/// Calls a function after the edit that removes its declaration, from the
+/// interpreter that ran it.
+bool checkRetained() {
+  llox::StringOutputSink output;
+  llox::StringOutputSink errors;
+  llox::InterpreterOptions options;
+  options.output = &output;
+  options.errors = &errors;
+  llox::Interpreter interpreter(options);
+  llox::Document document("fun kept() { return \"kept\"; }\n");
+  document.interpret(interpreter);
+  document.edit(0, document.getText().size(), "print kept();\n");
+  document.interpret(interpreter);
+  if (output.str() == "kept\n" && errors.str().empty()) return true;
+  std::cout << "a function did not survive the edit of its declaration\n";
+  return false;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<char*> arguments = absl::ParseCommandLine(argc, argv);
+  if (arguments.size() != 2) {
+    std::cerr << "usage: " << arguments[0] << " [--edits=N] [--seed=S] "
+              << "<script>\n";
+    return 1;
+  }
+  std::unique_ptr<llox::SourceBuffer> source =
+      llox::SourceBuffer::open(arguments[1]);
+  if (!source) {
+    std::cerr << "error: cannot read '" << arguments[1] << "'\n";
+    return 1;
+  }
+
+  if (!checkRetained()) return 1;
+
+  const std::string original(source->view());
+  std::string text = original;
+  llox::Document document(text);
+  std::mt19937 random(absl::GetFlag(FLAGS_seed));
+  for (int32_t round = 0; round < absl::GetFlag(FLAGS_edits); ++round) {
+    Edit edit = randomEdit(text, original, random);
+    std::string replaced = text.substr(edit.offset, edit.length);
+    if (!apply(edit, document, text)) {
+      report(edit, text);
+      return 1;
+    }
+
+    Edit undo = {edit.offset, edit.replacement.size(), replaced};
+    if (!apply(undo, document, text)) {
+      report(undo, text);
+      return 1;
+    }
+  }
+
+  std::cout << "ok\n";
+  return 0;
+}
@@ -1,5 +1,11 @@
+#include <unistd.h>
+
+#include <cstdlib>
+#include <exception>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <streambuf>
 #include <string>
 #include <vector>
@@ -9,59 +15,519 @@
 #include "lox/ast-printer.h"
 #include "lox/ast.h"
 #include "lox/interpreter.h"
+#include "lox/memory-stats.h"
+#include "lox/output.h"
 #include "lox/parser.h"
+#include "lox/perf-map.h"
+#include "lox/pool.h"
+#include "lox/program-cache.h"
+#include "lox/profiler.h"
+#include "lox/program.h"
+#include "lox/region.h"
+#include "lox/sampler.h"
 #include "lox/scanner.h"
+#include "lox/server.h"
+#include "lox/snapshot.h"
+#include "lox/source-buffer.h"
+#include "lox/thread-pool.h"
 #include "lox/token.h"
+#include "lox/trace.h"
 
 ABSL_FLAG(bool, print_ast, false,
           "Print the Abstract Syntax Tree (AST) of the input file.");
+ABSL_FLAG(bool, gc_stats, false,
+          "Print garbage collector statistics to stderr on exit.");
+ABSL_FLAG(int64_t, gc_heap_size, llox::HeapOptions::kDefaultInitialSize,
+          "Heap size in bytes at which the first garbage collection runs.");
+ABSL_FLAG(double, gc_growth_factor, llox::HeapOptions::kDefaultGrowthFactor,
+          "Multiple of the surviving heap size at which the next garbage "
+          "collection runs.");
+ABSL_FLAG(bool, mem_stats, false,
+          "Print the number and size of the tokens, syntax tree nodes, "
+          "values, strings and environments allocated, and the peak RSS, to "
+          "stderr at exit.");
+ABSL_FLAG(bool, region, false,
+          "Allocate everything for a script run from a single region that is "
+          "released wholesale at exit, without collecting or running "
+          "destructors. Meant for short one-shot runs.");
+ABSL_FLAG(bool, legacy_number_format, false,
+          "Print numbers with six fixed decimals, as earlier releases did.");
+ABSL_FLAG(int64_t, max_steps, 0,
+          "Stop each run with an error after it executes this many "
+          "statements. 0 for no limit.");
+ABSL_FLAG(int64_t, max_time_ms, 0,
+          "Stop each run with an error after this many milliseconds. 0 for "
+          "no limit.");
+ABSL_FLAG(int64_t, max_heap_bytes, 0,
+          "Stop each run with an error once its live heap objects take more "
+          "than this many bytes. 0 for no limit.");
+ABSL_FLAG(bool, batch, false,
+          "Run every input file, each in its own interpreter, on a pool of "
+          "worker threads. Output is printed per file, in argument order.");
+ABSL_FLAG(int32_t, jobs, 0,
+          "Number of worker threads for --batch; 0 means one per core.");
+ABSL_FLAG(bool, compile_cache, false,
+          "Load the compiled form of an input file from a .loxc file next to "
+          "it, and write one when it is missing or stale.");
 
-static void run(const std::string& source, llox::Interpreter& interpreter) {
-  llox::Scanner scanner(source);
-  std::unique_ptr<llox::Scanner::TokenList> tokens = scanner.scanTokens();
-  llox::Parser parser(std::move(tokens));
-  std::unique_ptr<llox::StmtList> statements = parser.parse();
+ABSL_FLAG(std::string, snapshot, "",
+          "Define the global variables stored in this image, written by "
+          "--snapshot_out, before running the input.");
+ABSL_FLAG(std::string, snapshot_out, "",
+          "After running the input file, write an image of its global "
+          "variables to this path.");
+ABSL_FLAG(bool, parallel_parse, false,
+          "Scan and parse large input files in pieces on --jobs threads.");
+ABSL_FLAG(bool, stream, false,
+          "Execute each top-level statement of the input file as soon as it "
+          "is parsed, reading the file in chunks, so that memory use does "
+          "not grow with its size. Statements before a syntax error still "
+          "run. Ignores --region, --compile_cache and --print_ast.");
+ABSL_FLAG(bool, profile, false,
+          "Count and time the statements and expressions run by each line of "
+          "the input file, and print the hottest lines and the annotated "
+          "source to stderr at exit. Ignores --stream and --region.");
+ABSL_FLAG(std::string, sample_out, "",
+          "Sample the Lox call stack every millisecond of CPU time and write "
+          "the stacks to this path, collapsed for flamegraph.pl. Not "
+          "supported with --serve.");
+ABSL_FLAG(std::string, trace_out, "",
+          "Record the time spent reading, compiling and running the input, "
+          "and in each garbage collection, and write it to this path as a "
+          "Chrome trace for about://tracing or Perfetto. Not supported with "
+          "--serve.");
+ABSL_FLAG(bool, perf_map, false,
+          "Call each Lox function through a trampoline of its own, named "
+          "after it in /tmp/perf-<pid>.map, so that `perf record -g` call "
+          "stacks show the Lox functions running. Needs a build with frame "
+          "pointers.");
+ABSL_FLAG(std::string, serve, "",
+          "Serve script runs on the Unix domain socket at this path until "
+          "killed, keeping workers and compiled scripts warm between runs.");
+ABSL_FLAG(int64_t, serve_timeout_ms, 60000,
+          "With --serve, close connections that send nothing, or take none "
+          "of their output, for this many milliseconds. Zero waits forever.");
+ABSL_FLAG(int32_t, serve_connections, 64,
+          "With --serve, the number of connections served at once. Further "
+          "ones are turned away with exit status 75.");
+ABSL_FLAG(std::string, connect, "",
+          "Run the input file, or stdin if there is none, on the server "
+          "listening at this socket path.");
 
-  if (statements) {
-    bool should_print_ast = absl::GetFlag(FLAGS_print_ast);
+// Runs `program`, or prints its AST with --print_ast. Returns false if it
+// stopped with a runtime error.
+static bool execute(const llox::Program& program,
+                    llox::Interpreter& interpreter) {
+  bool should_print_ast = absl::GetFlag(FLAGS_print_ast);
 
-    if (should_print_ast) {
-      llox::AstPrinter printer;
-      std::cout << printer.print(*statements) << "\n";
-    } else {
-      interpreter.interpret(*statements);
-    }
+  if (should_print_ast) {
+    llox::AstPrinter printer;
+    interpreter.outputSink().write(printer.print(program.getStatements()) +
+                                   "\n");
+    return true;
+  }
+  return interpreter.interpret(program);
+}
+
+static std::unique_ptr<const llox::Program> parse(
+    const llox::SourceBuffer& source, llox::OutputSink& errors) {
+  if (!absl::GetFlag(FLAGS_parallel_parse))
+    return llox::Program::compile(source, errors);
+
+  llox::ThreadPool pool(absl::GetFlag(FLAGS_jobs));
+  return llox::Program::compile(source, pool, errors);
+}
+
+// Compiles `source`, going through the `.loxc` cache next to `path` when
+// --compile_cache is set. A cache that cannot be written is not an error.
+static std::unique_ptr<const llox::Program> compile(
+    const llox::SourceBuffer& source, const char* path,
+    llox::OutputSink& errors) {
+  if (!path || !absl::GetFlag(FLAGS_compile_cache))
+    return parse(source, errors);
+
+  std::string cache = std::string(path) + "c";
+  std::uint64_t hash = llox::ProgramCache::hashSource(source.view());
+  std::unique_ptr<const llox::Program> program =
+      llox::ProgramCache::load(cache, hash);
+  if (program) return program;
+
+  program = parse(source, errors);
+  if (program) llox::ProgramCache::store(*program, hash, cache);
+  return program;
+}
+
+// Compiles and runs `source`, setting `status` to the exit status of the
+// run. The program is returned because functions it declared refer to it, so
+// it must be kept for as long as the interpreter.
+static std::unique_ptr<const llox::Program> run(
+    const llox::SourceBuffer& source, llox::Interpreter& interpreter,
+    const char* path = nullptr, int* status = nullptr) {
+  std::unique_ptr<const llox::Program> program =
+      compile(source, path, interpreter.errorSink());
+  if (!program) {
+    if (status) *status = llox::kSyntaxErrorStatus;
+    return nullptr;
   }
+
+  if (!execute(*program, interpreter) && status)
+    *status = llox::kRuntimeErrorStatus;
+
+  // The AST lives in the active region and is released along with it.
+  if (llox::Region::active()) program.release();
+  return program;
+}
+
+static llox::InterpreterOptions interpreterOptions(
+    llox::OutputSink* output, llox::OutputSink* errors = nullptr) {
+  llox::InterpreterOptions options;
+  options.heap.initialSize = absl::GetFlag(FLAGS_gc_heap_size);
+  options.heap.growthFactor = absl::GetFlag(FLAGS_gc_growth_factor);
+  options.output = output;
+  options.errors = errors;
+  options.legacyNumberFormat = absl::GetFlag(FLAGS_legacy_number_format);
+  options.budget.maxSteps = absl::GetFlag(FLAGS_max_steps);
+  options.budget.maxTime =
+      std::chrono::milliseconds(absl::GetFlag(FLAGS_max_time_ms));
+  options.budget.maxHeapBytes = absl::GetFlag(FLAGS_max_heap_bytes);
+  return options;
+}
+
+// Boots `interpreter` from the --snapshot image, if one was given.
+static void loadSnapshot(llox::Interpreter& interpreter) {
+  std::string path = absl::GetFlag(FLAGS_snapshot);
+  if (path.empty() || interpreter.loadSnapshot(path)) return;
+  std::cerr << "error: cannot load snapshot '" << path << "'\n";
+  std::exit(1);
+}
+
+static void saveSnapshot(llox::Interpreter& interpreter) {
+  std::string path = absl::GetFlag(FLAGS_snapshot_out);
+  if (path.empty() || interpreter.saveSnapshot(path)) return;
+  interpreter.outputSink().flush();
+  std::cerr << "error: cannot write snapshot '" << path << "'\n";
+  std::exit(1);
+}
+
+static void startSampling() {
+  if (absl::GetFlag(FLAGS_sample_out).empty() || llox::Sampler::start())
+    return;
+  std::cerr << "error: cannot start the sampling profiler\n";
+  std::exit(1);
+}
+
+// Writes the --sample_out profile. The samples refer to the functions of
+// the programs that ran, so this must be called before they are freed.
+static void finishSampling() {
+  std::string path = absl::GetFlag(FLAGS_sample_out);
+  if (path.empty()) return;
+  llox::Sampler::stop();
+  llox::StringOutputSink samples;
+  llox::Sampler::write(samples);
+  std::ofstream out(path, std::ios::binary);
+  if (!(out << samples.str()))
+    std::cerr << "error: cannot write samples to '" << path << "'\n";
+}
+
+// Writes the --trace_out timeline.
+static void finishTracing() {
+  std::string path = absl::GetFlag(FLAGS_trace_out);
+  if (path.empty() || llox::Trace::write(path)) return;
+  std::cerr << "error: cannot write trace to '" << path << "'\n";
+}
+
+// Starts recording the --trace_out timeline, which is written at exit.
+static void startTracing() {
+  if (absl::GetFlag(FLAGS_trace_out).empty()) return;
+  llox::Trace::start();
+  std::atexit(finishTracing);
+}
+
+static void printStats(const llox::Interpreter& interpreter) {
+  if (absl::GetFlag(FLAGS_gc_stats)) {
+    interpreter.getHeap().printStats(std::cerr);
+    llox::ObjectPool::printStats(std::cerr);
+  }
+  if (absl::GetFlag(FLAGS_mem_stats)) llox::MemoryStats::printStats(std::cerr);
+}
+
+// Runs `source` with every token, AST node, environment and runtime object
+// placed in one region, then exits without tearing any of it down.
+[[noreturn]] static void runInRegion(const llox::SourceBuffer& source,
+                                     const char* path,
+                                     llox::OutputSink& output) {
+  llox::Region* region = new llox::Region();
+  llox::RegionScope scope(region);
+
+  llox::InterpreterOptions options = interpreterOptions(&output);
+  options.heap.region = region;
+  llox::Interpreter* interpreter = new llox::Interpreter(options);
+
+  loadSnapshot(*interpreter);
+  int status = 0;
+  run(source, *interpreter, path, &status);
+  saveSnapshot(*interpreter);
+  printStats(*interpreter);
+  finishSampling();
+  finishTracing();
+  if (absl::GetFlag(FLAGS_gc_stats))
+    std::cerr << "region: bytes used: " << region->used() << "\n"
+              << "region: bytes reserved: " << region->reserved() << "\n";
+
+  output.flush();
+  std::cout.flush();
+  std::cerr.flush();
+  std::_Exit(status);
+}
+
+// Maps the file at `path`. A file that cannot be opened reads as empty.
+static std::unique_ptr<llox::SourceBuffer> readFile(const char* path) {
+  LLOX_TRACE_SPAN(span, "read");
+  std::unique_ptr<llox::SourceBuffer> source = llox::SourceBuffer::open(path);
+  if (!source) source.reset(new llox::SourceBuffer(std::string()));
+  LLOX_TRACE_ARG(span, "bytes", source->size());
+  return source;
+}
+
+// Runs the file at `path` statement by statement, as it is scanned and
+// parsed. Execution stops at the first syntax error. Returns the exit status.
+static int runStream(const char* path, llox::Interpreter& interpreter) {
+  LLOX_TRACE_SPAN(span, "stream");
+  std::ifstream input(path, std::ios::binary);
+  llox::Scanner scanner(input, interpreter.errorSink());
+  llox::Parser parser(scanner, interpreter.errorSink());
+
+  // Statements that declare functions are kept, since the functions refer
+  // to them. Others are freed as soon as they have run.
+  std::vector<std::unique_ptr<llox::Stmt>> declarations;
+  while (std::unique_ptr<llox::Stmt> stmt = parser.next()) {
+    if (parser.hadError()) break;
+    interpreter.interpret(*stmt);
+    if (parser.declaresFunction()) declarations.push_back(std::move(stmt));
+  }
+
+  int status = 0;
+  if (parser.hadError())
+    status = llox::kSyntaxErrorStatus;
+  else if (!interpreter.finish())
+    status = llox::kRuntimeErrorStatus;
+  LLOX_TRACE_ARG(span, "tokens", scanner.tokenCount());
+  LLOX_TRACE_ARG(span, "statements", interpreter.statementsExecuted());
+  finishSampling();
+  return status;
+}
+
+// Runs the file at `path` in a `ProfilingInterpreter` and reports on it.
+static int runProfiled(const char* path) {
+  std::unique_ptr<llox::SourceBuffer> source = readFile(path);
+  llox::FileOutputSink output(STDOUT_FILENO);
+  llox::ProfilingInterpreter interpreter(interpreterOptions(&output));
+  loadSnapshot(interpreter);
+  int status = 0;
+  std::unique_ptr<const llox::Program> program =
+      run(*source, interpreter, path, &status);
+  saveSnapshot(interpreter);
+  printStats(interpreter);
+  finishSampling();
+  output.flush();
+  interpreter.report(source->view(), llox::standardError());
+  return status;
 }
 
-static void runFile(const char* path) {
-  llox::Interpreter interpreter;
-  std::ifstream t(path);
-  std::string str((std::istreambuf_iterator<char>(t)),
-                  std::istreambuf_iterator<char>());
-  run(str, interpreter);
+// Runs the file at `path` and returns the exit status.
+static int runFile(const char* path) {
+  if (absl::GetFlag(FLAGS_profile)) return runProfiled(path);
+
+  if (absl::GetFlag(FLAGS_stream)) {
+    llox::FileOutputSink output(STDOUT_FILENO);
+    llox::Interpreter interpreter(interpreterOptions(&output));
+    loadSnapshot(interpreter);
+    int status = runStream(path, interpreter);
+    saveSnapshot(interpreter);
+    printStats(interpreter);
+    return status;
+  }
+
+  std::unique_ptr<llox::SourceBuffer> source = readFile(path);
+
+  llox::FileOutputSink output(STDOUT_FILENO);
+  if (absl::GetFlag(FLAGS_region)) runInRegion(*source, path, output);
+
+  llox::Interpreter interpreter(interpreterOptions(&output));
+  loadSnapshot(interpreter);
+  int status = 0;
+  std::unique_ptr<const llox::Program> program =
+      run(*source, interpreter, path, &status);
+  saveSnapshot(interpreter);
+  printStats(interpreter);
+  finishSampling();
+  return status;
 }
 
 static void runPrompt() {
-  llox::Interpreter interpreter;
+  llox::FileOutputSink output(STDOUT_FILENO);
+  llox::Interpreter interpreter(interpreterOptions(&output));
+  loadSnapshot(interpreter);
+  std::vector<std::unique_ptr<const llox::Program>> programs;
   for (;;) {
-    std::cout << "> ";
+    output.write("> ");
+    output.flush();
+
+    std::string line;
+    if (!std::getline(std::cin, line)) break;
+    programs.push_back(run(llox::SourceBuffer(std::move(line)), interpreter));
+    output.flush();
+  }
+  printStats(interpreter);
+  finishSampling();
+}
+
+// Runs each script in its own interpreter on a thread pool. Each distinct
+// path is compiled once, and all runs of it share the compiled program. Each
+// run's output and diagnostics are collected in memory and printed, under a
+// header naming the script, in the order the scripts were given.
+static void runBatch(const std::vector<char*>& paths) {
+  struct Compilation {
+    std::shared_ptr<const llox::Program> program;
+    llox::StringOutputSink errors;
+  };
+  std::map<std::string, Compilation> compilations;
+  for (const char* path : paths) compilations[path];
+
+  struct Result {
+    llox::StringOutputSink output;
+    llox::StringOutputSink errors;
+  };
+  std::vector<Result> results(paths.size());
+
+  {
+    llox::ThreadPool pool(absl::GetFlag(FLAGS_jobs));
+    for (auto& entry : compilations) {
+      pool.submit([&entry] {
+        Compilation& compilation = entry.second;
+        compilation.program = llox::Program::compile(
+            *readFile(entry.first.c_str()), compilation.errors);
+      });
+    }
+    pool.wait();
 
-    std::string source;
-    std::getline(std::cin, source);
-    run(source, interpreter);
+    for (std::size_t index = 0; index < paths.size(); ++index) {
+      const Compilation& compilation = compilations.at(paths[index]);
+      Result& result = results[index];
+      result.errors.write(compilation.errors.str());
+      if (!compilation.program) continue;
+
+      std::shared_ptr<const llox::Program> program = compilation.program;
+      pool.submit([program, &result] {
+        llox::Interpreter interpreter(
+            interpreterOptions(&result.output, &result.errors));
+        execute(*program, interpreter);
+      });
+    }
+  }
+
+  llox::FileOutputSink output(STDOUT_FILENO);
+  for (std::size_t index = 0; index < paths.size(); ++index) {
+    output.write("==> " + std::string(paths[index]) + " <==\n");
+    output.write(results[index].output.str());
+    llox::standardError().write(results[index].errors.str());
+  }
+  if (absl::GetFlag(FLAGS_mem_stats)) llox::MemoryStats::printStats(std::cerr);
+  finishSampling();
+}
+
+static int serve(const std::string& path) {
+  llox::ServerOptions options;
+  options.interpreter = interpreterOptions(nullptr);
+  options.jobs = absl::GetFlag(FLAGS_jobs);
+  options.timeout =
+      std::chrono::milliseconds(absl::GetFlag(FLAGS_serve_timeout_ms));
+  if (absl::GetFlag(FLAGS_serve_connections) < 1) {
+    std::cerr << "error: --serve_connections must be at least 1\n";
+    return 1;
+  }
+  options.maxConnections = absl::GetFlag(FLAGS_serve_connections);
+
+  llox::Server server(options);
+  if (!server.listen(path)) {
+    std::cerr << "error: cannot listen on '" << path << "'\n";
+    return 1;
   }
+  server.serve();
+  return 1;
+}
+
+static int runRemote(const std::string& path, const char* file) {
+  std::unique_ptr<llox::SourceBuffer> source =
+      file ? readFile(file) : llox::SourceBuffer::read(STDIN_FILENO);
+  if (!source) {
+    std::cerr << "error: cannot read stdin\n";
+    return 1;
+  }
+
+  llox::Client client;
+  llox::FileOutputSink output(STDOUT_FILENO);
+  int status = client.connect(path)
+                   ? client.run(*source, output, llox::standardError())
+                   : -1;
+  if (status < 0) {
+    output.flush();
+    std::cerr << "error: cannot run on server '" << path << "'\n";
+    return 1;
+  }
+  return status;
+}
+
+// Keeps what the script printed before a fatal error, such as running out
+// of memory, instead of losing it in a buffer.
+[[noreturn]] static void terminate() {
+  llox::FileOutputSink::flushAll();
+  std::abort();
 }
 
 int main(int argc, char** argv) {
   std::vector<char*> non_flag_args = absl::ParseCommandLine(argc, argv);
+  std::set_terminate(terminate);
+
+  // A negative count would wrap to billions of workers.
+  if (absl::GetFlag(FLAGS_jobs) < 0) {
+    std::cerr << "error: --jobs must not be negative\n";
+    return 1;
+  }
+  // As a size_t threshold, a negative heap size would never be reached.
+  if (absl::GetFlag(FLAGS_gc_heap_size) < 0) {
+    std::cerr << "error: --gc_heap_size must not be negative\n";
+    return 1;
+  }
+
+  if (absl::GetFlag(FLAGS_perf_map) && !llox::PerfMap::open()) {
+    std::cerr << "error: cannot create the perf map\n";
+    return 1;
+  }
+
+  if (!absl::GetFlag(FLAGS_serve).empty())
+    return serve(absl::GetFlag(FLAGS_serve));
+
+  if (!absl::GetFlag(FLAGS_connect).empty())
+    return runRemote(absl::GetFlag(FLAGS_connect),
+                     non_flag_args.size() > 1 ? non_flag_args[1] : nullptr);
+
+  if (absl::GetFlag(FLAGS_mem_stats)) llox::MemoryStats::enable();
+  startSampling();
+  startTracing();
+
+  if (absl::GetFlag(FLAGS_batch)) {
+    runBatch(std::vector<char*>(non_flag_args.begin() + 1,
+                                non_flag_args.end()));
+    return 0;
+  }
 
   if (non_flag_args.size() > 2) {
     std::cerr << "usage: " << non_flag_args[0]
               << " --print-ast=<true|false> <input_file>\n";
     return 1;
   } else if (non_flag_args.size() == 2) {
-    runFile(non_flag_args[1]);
+    return runFile(non_flag_args[1]);
   } else {
     runPrompt();
   }
@@ -0,0 +1,47 @@
+#!/bin/bash
+#
+# Trains a profile for lox, builds it with the profile and ThinLTO, and
+# compares the result against a plain optimized build on the macro
+# benchmarks.
+#
+#   tools/pgo/train.sh [RUNS]
+#
+# The training workload is every script under test/ and bench/macro/, and
+# the microbenchmarks over the generated corpus. The merged profile is left
+# in tools/pgo/lox.profdata, where `bazel build --config=pgo` expects it.
+# Needs clang and llvm-profdata.
+
+set -euo pipefail
+
+cd "$(dirname "$0")/../.."
+runs="${1:-10}"
+profiles=/tmp/lox-pgo
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+
+echo "==> Building the instrumented binaries"
+rm -rf "$profiles"
+bazel build --config=pgo-instrument //tools/driver:lox //bench:all
+bin="$(bazel info --config=pgo-instrument bazel-bin)"
+
+echo "==> Training"
+for script in test/*.lox bench/macro/*.lox; do
+  # Some tests fail on purpose; their profile is just as useful.
+  "$bin/tools/driver/lox" "$script" > /dev/null 2>&1 < /dev/null || true
+done
+for bench in scanner_bench parser_bench interpreter_bench; do
+  "$bin/bench/$bench" --benchmark_min_time=0.05s > /dev/null
+done
+llvm-profdata merge -output=tools/pgo/lox.profdata "$profiles"/*.profraw
+
+echo "==> Building the baseline and optimized binaries"
+bazel build -c opt //tools/driver:lox
+cp "$(bazel info -c opt bazel-bin)/tools/driver/lox" "$work/lox-opt"
+bazel build --config=pgo //tools/driver:lox
+cp "$(bazel info --config=pgo bazel-bin)/tools/driver/lox" "$work/lox-pgo"
+
+echo "==> Comparing"
+# Every improvement is reported as a negative change; the exit status is 1
+# only if the profile made some script slower.
+bazel run //utils/macrobench -- --runs="$runs" \
+    --lox="$work/lox-pgo" --baseline="$work/lox-opt" "$PWD"/bench/macro/*.lox
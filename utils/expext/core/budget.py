@@ -0,0 +1,48 @@
+import re
+
+# The budgets a PERF line can set, each with what it limits.
+BUDGETS = {
+    "max-ms": "wall time in milliseconds",
+    "max-rss-kb": "peak RSS in kilobytes",
+    "max-allocs": "objects allocated by the interpreter",
+}
+
+# What `lox --gc_stats` prints on stderr.
+ALLOCS_RE = re.compile(r"^gc: objects allocated: (\d+)$", re.MULTILINE)
+
+
+def parse_budgets(text):
+    """Parses the `name=limit` pairs of a PERF line."""
+    budgets = {}
+    for item in text.split():
+        name, _, limit = item.partition("=")
+        if name not in BUDGETS or not limit.isdigit():
+            raise ValueError(f"Invalid PERF budget '{item}'.")
+        budgets[name] = int(limit)
+    return budgets
+
+
+def measured(name, runner):
+    if name == "max-ms":
+        return runner.elapsed_ms
+    if name == "max-rss-kb":
+        return runner.max_rss_kb
+    match = ALLOCS_RE.search(runner.stderr)
+    return int(match.group(1)) if match else None
+
+
+def check_budgets(budgets, runner):
+    """Returns a message for each budget in `budgets` that `runner`'s run
+    exceeded."""
+    failures = []
+    for name, limit in budgets.items():
+        value = measured(name, runner)
+        if value is None:
+            failures.append(
+                f"No count of {BUDGETS[name]}; run lox with --gc_stats."
+            )
+        elif value > limit:
+            failures.append(
+                f"Exceeded {name}={limit}: {BUDGETS[name]} was {value:.0f}."
+            )
+    return failures
@@ -1,7 +1,10 @@
 import re
 
+from utils.expext.core.budget import parse_budgets
+
 RUN_LINE_RE = re.compile("^//\s+RUN(-[^:]+)?:(.+)$")
 CHECK_LINE_RE = re.compile("^//\s+(CHECK)(-[^:]+)?:(.+)$")
+PERF_LINE_RE = re.compile("^//\s+PERF(-[^:]+)?:(.+)$")
 
 
 def get_tag(name):
@@ -17,6 +20,7 @@ class Collector:
         self.filename = filename
         self.run_lines = []
         self.tagged_expextations = {}
+        self.tagged_budgets = {}
 
     def __enter__(self):
         try:
@@ -36,6 +40,11 @@ class Collector:
                     if tag not in self.tagged_expextations:
                         self.tagged_expextations[tag] = []
                     self.tagged_expextations[tag].append((cmd, check_line))
+                match = PERF_LINE_RE.match(line)
+                if match:
+                    tag, perf_line = get_tag(match.group(1)), match.group(2)
+                    budgets = self.tagged_budgets.setdefault(tag, {})
+                    budgets.update(parse_budgets(perf_line))
 
             return self
         except FileNotFoundError:
@@ -52,3 +61,6 @@ class Collector:
 
     def expextations(self, tag):
         return self.tagged_expextations[tag]
+
+    def budgets(self, tag):
+        return self.tagged_budgets.get(tag, {})
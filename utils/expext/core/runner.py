@@ -1,25 +1,53 @@
+import os
 import subprocess
+import tempfile
+import time
 
 
 def run_shell_command(command):
+    """Runs `command` and returns its status, stdout and stderr, the wall
+    time it took in milliseconds and its peak RSS in kilobytes."""
     try:
-        result = subprocess.run(
-            command, shell=True, capture_output=True, text=True, check=False
-        )
+        # The output goes to files rather than pipes, so that the child can
+        # be reaped here, along with its resource usage, once it exits.
+        with tempfile.TemporaryFile() as stdout, \
+                tempfile.TemporaryFile() as stderr:
+            start = time.perf_counter()
+            process = subprocess.Popen(
+                command, shell=True, stdout=stdout, stderr=stderr
+            )
+            _, status, usage = os.wait4(process.pid, 0)
+            elapsed_ms = (time.perf_counter() - start) * 1000
+            process.returncode = os.waitstatus_to_exitcode(status)
+            stdout.seek(0)
+            stderr.seek(0)
+            output = stdout.read().decode()
+            errors = stderr.read().decode()
 
-        return (result.returncode, result.stdout.strip(), result.stderr.strip())
+        return (
+            process.returncode,
+            output.strip(),
+            errors.strip(),
+            elapsed_ms,
+            usage.ru_maxrss,
+        )
 
     except FileNotFoundError:
-        return (127, "", f"Error: Command '{command}' not found.")
+        return (127, "", f"Error: Command '{command}' not found.", 0, 0)
     except Exception as e:
-        return (1, "", f"An unexpected error occurred: {e}")
+        return (1, "", f"An unexpected error occurred: {e}", 0, 0)
 
 
 class Runner:
     def __init__(self, run_line):
         self.run_line = run_line
+        self.stderr = ""
+        self.elapsed_ms = 0
+        self.max_rss_kb = 0
 
     def run(self):
-        code, stdout, stderr = run_shell_command(self.run_line)
+        code, stdout, self.stderr, self.elapsed_ms, self.max_rss_kb = (
+            run_shell_command(self.run_line)
+        )
         if not code:
             return stdout.split('\n')
@@ -4,6 +4,7 @@ import sys
 from utils.expext.core.collector import Collector
 from utils.expext.core.runner import Runner
 from utils.expext.core.matcher import Matcher
+from utils.expext.core.budget import check_budgets
 
 def main():
     filename = sys.argv[1]
@@ -20,6 +21,11 @@ def main():
             except KeyError as ke:
                 print(f"No checks are in place for {ke}.")
                 sys.exit(1)
+            failures = check_budgets(collector.budgets(tag), runner)
+            for failure in failures:
+                print(f"{tag}: {failure}")
+            if failures:
+                sys.exit(1)
 
 if __name__ == "__main__":
     main()
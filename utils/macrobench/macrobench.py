@@ -0,0 +1,124 @@
+#!/usr/bin/python
+
+"""Times the macro-benchmark scripts under one or two builds of `lox`.
+
+Each script is run `--runs` times. Its output is checked against its
+CHECK-EVAL lines, and the median and 95th percentile wall time and the
+peak RSS are reported. Given a `--baseline` build, the same is done for
+it and any script whose median time or peak RSS grew by more than
+`--threshold` is flagged as a regression, which makes the exit status 1.
+"""
+
+import argparse
+import json
+import math
+import os
+import statistics
+import subprocess
+import sys
+import time
+
+from utils.expext.core.collector import Collector
+from utils.expext.core.matcher import Matcher
+
+
+def run_once(lox, script):
+    """Runs `script` and returns (seconds, peak RSS in KB, stdout lines)."""
+    start = time.perf_counter()
+    process = subprocess.Popen(
+        [lox, script], stdout=subprocess.PIPE, stderr=subprocess.DEVNULL
+    )
+    stdout = process.stdout.read()
+    process.stdout.close()
+    _, status, usage = os.wait4(process.pid, 0)
+    seconds = time.perf_counter() - start
+    process.returncode = os.waitstatus_to_exitcode(status)
+    if process.returncode:
+        raise RuntimeError(f"{lox} {script} exited with {process.returncode}")
+    return seconds, usage.ru_maxrss, stdout.decode().strip().split("\n")
+
+
+def check_output(script, output):
+    with Collector(script) as collector:
+        matcher = Matcher(output)
+        for cmd, expextation in collector.expextations("EVAL"):
+            if not matcher.match("EVAL", cmd, expextation):
+                raise RuntimeError(f"{script}: failed to match '{expextation}'")
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[max(0, math.ceil(fraction * len(ordered)) - 1)]
+
+
+def measure(lox, script, runs):
+    times = []
+    rss = 0
+    for index in range(runs):
+        seconds, peak, output = run_once(lox, script)
+        if index == 0:
+            check_output(script, output)
+        times.append(seconds)
+        rss = max(rss, peak)
+    return {
+        "median_ms": statistics.median(times) * 1000,
+        "p95_ms": percentile(times, 0.95) * 1000,
+        "peak_rss_kb": rss,
+    }
+
+
+def change(new, old):
+    return (new - old) / old if old else 0.0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("scripts", nargs="+", help="the .lox files to run")
+    parser.add_argument("--lox", default="lox", help="the build to measure")
+    parser.add_argument("--baseline", help="a build to compare against")
+    parser.add_argument("--runs", type=int, default=10)
+    parser.add_argument("--threshold", type=float, default=0.05)
+    parser.add_argument("--json", help="also write the results here")
+    args = parser.parse_args()
+
+    results = {}
+    regressions = []
+    print(f"{'script':<24}{'median':>10}{'p95':>10}{'rss':>10}"
+          f"{'base':>10}{'change':>9}{'rss':>9}")
+    for script in args.scripts:
+        name = os.path.splitext(os.path.basename(script))[0]
+        try:
+            current = measure(args.lox, script, args.runs)
+            baseline = (measure(args.baseline, script, args.runs)
+                        if args.baseline else None)
+        except RuntimeError as error:
+            print(error)
+            sys.exit(1)
+
+        line = (f"{name:<24}{current['median_ms']:>8.1f}ms"
+                f"{current['p95_ms']:>8.1f}ms{current['peak_rss_kb']:>8}KB")
+        results[name] = {"current": current}
+        if baseline:
+            time_change = change(current["median_ms"], baseline["median_ms"])
+            rss_change = change(current["peak_rss_kb"],
+                                baseline["peak_rss_kb"])
+            results[name]["baseline"] = baseline
+            line += (f"{baseline['median_ms']:>8.1f}ms{time_change:>+9.1%}"
+                     f"{rss_change:>+9.1%}")
+            if time_change > args.threshold or rss_change > args.threshold:
+                regressions.append(name)
+                line += "  REGRESSION"
+        print(line)
+
+    if args.json:
+        with open(args.json, "w") as file:
+            json.dump(results, file, indent=2)
+
+    if regressions:
+        print(f"Regressed by more than {args.threshold:.0%}: "
+              f"{', '.join(regressions)}.")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()